@@ -8,6 +8,12 @@ extern "C"
 {
 #endif
 
+/*
+*   Encoders and decoders have no global state, and different instances
+*   can be used concurrently. (Global `Overflow` and `Carry` of the basic
+*   operators are only touched by 40-bit operators, which are not used.)
+*/
+
 /* Frame size at 16kHz                        */
 #define AMR_WB_PCM_FRAME_16k   320
 
@@ -135,6 +141,52 @@ int amr_wb_encoder_encode_frame(struct amr_wb_encoder *ctx, const int16_t *pcm_s
 int amr_wb_encoder_encode_frame2(struct amr_wb_encoder *ctx, int mode,
                                 const int16_t *pcm_samples, uint8_t *output, void *scratch);
 
+/*
+*   Frame types reported in `struct amr_wb_encoder_frame_info`
+*/
+#define AMR_WB_FRAME_TYPE_SPEECH                0
+#define AMR_WB_FRAME_TYPE_SID                   1
+#define AMR_WB_FRAME_TYPE_NO_DATA               2
+
+/**
+ * @brief Information of an encoded frame.
+ */
+struct amr_wb_encoder_frame_info
+{
+    uint8_t frame_type;     // see `AMR_WB_FRAME_TYPE_xxx`
+    uint8_t vad;            // voice activity detected in this frame (1) or not (0)
+    int16_t level;          // level of input samples in dBFS (-96 ~ 0)
+};
+
+/**
+ * @brief Switches mode, encodes a frame and reports frame information.
+ *
+ * Same as `amr_wb_encoder_encode_frame2`, and also reports the result of
+ * voice activity detection, the type of the encoded frame, and the level of
+ * input samples, so that later processing (de-noise, encryption, radio TX, etc)
+ * can be skipped for silence without parsing the frame header.
+ *
+ * VAD runs whether DTX is allowed or not. When DTX is allowed, note that
+ * a few frames after the end of a talk spurt are still speech frames (DTX
+ * hangover) although `vad` is 0, and SID frames must still be sent.
+ *
+ * @param[in] ctx           Pointer to the AMR-WB encoder context.
+ * @param[in] mode          Set to a new encoding mode (See `AMR_WB_MODE_xxx`).
+ * @param[in] pcm_samples   Pointer to the array of 16-bit PCM audio samples.
+ * @param[out] output       Pointer to the buffer where the encoded AMR-WB frame will be stored.
+ * @param[in,out] scratch   Pointer to a scratch buffer used internally by the encoder.
+ * @param[out] info         Information of the encoded frame.
+ *
+ * @note VAD and TX type are read from the prebuilt encoder by the offsets of
+ *       `src/amr_wb/amr_wb_priv.h`, which match only the libraries of the
+ *       same release of this repository.
+ *
+ * @return                  Length of encoded frame (header + payload) in bytes.
+ */
+int amr_wb_encoder_encode_frame3(struct amr_wb_encoder *ctx, int mode,
+                                 const int16_t *pcm_samples, uint8_t *output, void *scratch,
+                                 struct amr_wb_encoder_frame_info *info);
+
 /**@}*/
 /**
  * @defgroup AWR-WB decoder
@@ -225,6 +277,440 @@ int amr_wb_decoder_probe(struct amr_wb_decoder *ctx, const uint8_t *stream);
 int amr_wb_decoder_decode_frame(struct amr_wb_decoder *ctx, const uint8_t *payload, int16_t *synth_pcm,
                                 void *scratch);
 
+/* The frame is damaged (bad CRC, bit errors reported by the link layer, etc) */
+#define AMR_WB_DECODER_FLAG_BAD_FRAME   1
+
+/**
+ * @brief Decodes/Synthesizes a frame of AMR-WB encoded audio with flags.
+ *
+ * Same as `amr_wb_decoder_decode_frame`, with additional flags. When
+ * `AMR_WB_DECODER_FLAG_BAD_FRAME` is set, the frame is decoded as a bad frame
+ * (as if the quality bit in its header were cleared): the decoder uses
+ * the parameters it can trust, and conceals the rest.
+ *
+ * @param[in]  ctx          Pointer to the AMR-WB decoder context.
+ * @param[in]  payload      Pointer to the input AMR-WB encoded payload.
+ * @param[in]  flags        Combination of `AMR_WB_DECODER_FLAG_xxx`.
+ * @param[out] synth_pcm    Pointer to the buffer where the decoded PCM samples will be stored.
+ * @param[in]  scratch      Pointer to the scratch buffer used for intermediate computations.
+ *
+ * @note The quality bit is cleared in the prebuilt decoder through the layout
+ *       of `src/amr_wb/amr_wb_priv.h`, which matches only the libraries of
+ *       the same release of this repository.
+ *
+ * @return                  Returns number of PCM samples that are decoded.
+ *                          (i.e. `AMR_WB_PCM_FRAME_16k`)
+ */
+int amr_wb_decoder_decode_frame2(struct amr_wb_decoder *ctx, const uint8_t *payload, int flags,
+                                 int16_t *synth_pcm, void *scratch);
+
+/**
+ * @brief Synthesizes a frame for a lost frame.
+ *
+ * Call this (instead of `amr_wb_decoder_probe` and `amr_wb_decoder_decode_frame`)
+ * when a frame is lost, or arrives too late to be played. The decoder
+ * extrapolates the previous frames (error concealment), and fades out when
+ * frames keep missing. During DTX, comfort noise is generated instead.
+ *
+ * @param[in]  ctx          Pointer to the AMR-WB decoder context.
+ * @param[out] synth_pcm    Pointer to the buffer where the synthesized PCM samples will be stored.
+ * @param[in]  scratch      Pointer to the scratch buffer used for intermediate computations.
+ *
+ * @return                  Returns number of PCM samples that are synthesized.
+ *                          (i.e. `AMR_WB_PCM_FRAME_16k`)
+ *                          A negative value is returned when error occurs.
+ */
+int amr_wb_decoder_conceal_frame(struct amr_wb_decoder *ctx, int16_t *synth_pcm, void *scratch);
+
+/**
+ * @brief Resampler for converting decoded frames (16kHz) to another sample rate.
+ *
+ * Supported output sample rates: 8000, 16000 (bypass), 44100 and 48000.
+ *
+ * Fields are internal: use `amr_wb_resampler_xxx` functions.
+ */
+struct amr_wb_resampler
+{
+    int out_rate;
+    uint32_t pos;               // position of next output sample (in 1/out_rate input samples)
+    int16_t history[32];
+};
+
+/**
+ * @brief Initializes a resampler.
+ *
+ * @param[in] rs            The resampler.
+ * @param[in] out_rate      Output sample rate.
+ * @return                  0 if succeeded else -1 (sample rate not supported).
+ */
+int amr_wb_resampler_init(struct amr_wb_resampler *rs, int out_rate);
+
+/**
+ * @brief Gets the size of the frame buffer for a resampler.
+ *
+ * Frames are converted in-place: the 16kHz input frame and the output
+ * share the same buffer. Since the number of output samples of a frame
+ * may vary (44.1kHz for example), the buffer is a bit larger than
+ * a frame of output.
+ *
+ * @param[in] out_rate      Output sample rate.
+ * @return                  Size of the buffer in samples, or -1 (sample rate not supported).
+ */
+int amr_wb_resampler_get_buf_size(int out_rate);
+
+/**
+ * @brief Gets where to put a 16kHz frame in the frame buffer.
+ *
+ * @param[in] rs            The resampler.
+ * @param[in] buf           The frame buffer (see `amr_wb_resampler_get_buf_size`).
+ * @return                  Where `AMR_WB_PCM_FRAME_16k` input samples shall be put.
+ */
+int16_t *amr_wb_resampler_get_input(const struct amr_wb_resampler *rs, int16_t *buf);
+
+/**
+ * @brief Converts a frame in the frame buffer.
+ *
+ * The input frame is at `amr_wb_resampler_get_input(rs, buf)`, and the
+ * output is written from `buf[0]`. Output is delayed by about 1ms.
+ *
+ * @param[in] rs            The resampler.
+ * @param[in,out] buf       The frame buffer.
+ * @return                  Number of output samples.
+ */
+int amr_wb_resampler_process(struct amr_wb_resampler *rs, int16_t *buf);
+
+/**
+ * @brief Decodes a frame and converts it to another sample rate.
+ *
+ * The frame is decoded into the frame buffer which is then converted in-place,
+ * so no additional 16kHz frame buffer is needed.
+ *
+ * Example:
+ *
+ * ```c
+ * static struct amr_wb_resampler rs;
+ * static int16_t pcm[(AMR_WB_PCM_FRAME_16k * 3) + 32];  // >= amr_wb_resampler_get_buf_size(48000)
+ *
+ * amr_wb_resampler_init(&rs, 48000);
+ * ...
+ * amr_wb_decoder_probe(ctx, stream);
+ * n = amr_wb_decoder_decode_frame_resampled(ctx, stream + header_size, &rs, pcm, scratch);
+ * i2s_write(pcm, n);
+ * ```
+ *
+ * @param[in]  ctx          Pointer to the AMR-WB decoder context.
+ * @param[in]  payload      Pointer to the input AMR-WB encoded payload.
+ * @param[in]  rs           The resampler.
+ * @param[out] buf          The frame buffer (see `amr_wb_resampler_get_buf_size`).
+ * @param[in]  scratch      Pointer to the scratch buffer used for intermediate computations.
+ *
+ * @return                  Returns number of PCM samples in `buf` (at the output sample rate).
+ */
+int amr_wb_decoder_decode_frame_resampled(struct amr_wb_decoder *ctx, const uint8_t *payload,
+                                          struct amr_wb_resampler *rs, int16_t *buf, void *scratch);
+
+/* Magic number at the beginning of an AMR-WB MIME/storage file (RFC 4867, section 5) */
+#define AMR_WB_MIME_MAGIC       "#!AMR-WB\n"
+#define AMR_WB_MIME_MAGIC_LEN   9
+
+/**
+ * @brief Decodes consecutive frames of an AMR-WB MIME/IETF stream.
+ *
+ * This function walks the stream frame by frame (header, payload, next header ...)
+ * and decodes up to `max_frames` frames into `pcm_out`. The `#!AMR-WB\n` magic is
+ * skipped when the stream starts with it, so a whole file, or any part of it that
+ * starts at a frame boundary, can be passed in directly.
+ *
+ * NO_DATA frames are decoded as well: the decoder produces comfort noise (after a
+ * SID frame) or concealment for them, so every frame always yields
+ * `AMR_WB_PCM_FRAME_16k` samples and the output keeps the timing of the stream.
+ *
+ * Decoding stops when `max_frames` frames are decoded, or when the remaining data
+ * does not hold a complete frame. In the latter case, the incomplete frame is not
+ * consumed, and can be passed in again together with more data.
+ *
+ * Example (playback from memory-mapped flash):
+ *
+ * ```c
+ * int consumed;
+ * while (len > 0)
+ * {
+ *     int n = amr_wb_decoder_decode_stream(ctx, stream, len, pcm, 10, scratch, &consumed);
+ *     if (n <= 0) break;
+ *     play(pcm, n * AMR_WB_PCM_FRAME_16k);
+ *     stream += consumed;
+ *     len -= consumed;
+ * }
+ * ```
+ *
+ * @param[in]  ctx          Pointer to the AMR-WB decoder context
+ *                          (initialized with `AMR_WB_BIT_STREAM_FORMAT_MIME_IETF`).
+ * @param[in]  stream       Pointer to the input stream.
+ * @param[in]  len          Length of the input stream in bytes.
+ * @param[out] pcm_out      Pointer to the buffer where the decoded PCM samples will be stored.
+ *                          It must hold at least `max_frames * AMR_WB_PCM_FRAME_16k` samples.
+ * @param[in]  max_frames   Maximum number of frames to be decoded.
+ * @param[in]  scratch      Pointer to the scratch buffer used for intermediate computations.
+ * @param[out] consumed     Number of bytes consumed from the stream, including the magic
+ *                          (optional, can be NULL).
+ *
+ * @return                  Number of frames decoded.
+ *                          A negative value is returned when error occurs.
+ */
+int amr_wb_decoder_decode_stream(struct amr_wb_decoder *ctx, const uint8_t *stream, int len,
+                                 int16_t *pcm_out, int max_frames, void *scratch, int *consumed);
+
+/**@}*/
+
+/**
+ * @defgroup AMR-WB RTP payload format (RFC 4867)
+ *
+ * Frames produced by the encoder in `AMR_WB_BIT_STREAM_FORMAT_MIME_IETF` format are
+ * packed into RTP payloads, and RTP payloads are unpacked into MIME/IETF frames
+ * which can be fed to the decoder (`amr_wb_decoder_decode_stream` for example).
+ *
+ * Single channel only. Interleaving, frame CRCs and robust sorting are not supported
+ * (i.e. `interleaving`, `crc` and `robust-sorting` must not be negotiated).
+ */
+/**@{*/
+
+#define AMR_WB_RTP_OCTET_ALIGNED            0
+#define AMR_WB_RTP_BANDWIDTH_EFFICIENT      1
+
+/* CMR value meaning "no mode request" */
+#define AMR_WB_CMR_NO_REQUEST               15
+
+/**
+ * @brief RTP payload packer.
+ *
+ * Fields are internal: use `amr_wb_rtp_packer_xxx` functions.
+ */
+struct amr_wb_rtp_packer
+{
+    uint8_t *packet;
+    int capacity;
+    int payload_format;
+    int frames_per_packet;
+    int frame_num;
+    int pos;                // in bytes (octet-aligned) or bits (bandwidth-efficient)
+};
+
+/**
+ * @brief Gets the maximum size of a packet.
+ *
+ * @param[in] payload_format        `AMR_WB_RTP_OCTET_ALIGNED` or `AMR_WB_RTP_BANDWIDTH_EFFICIENT`.
+ * @param[in] frames_per_packet     Number of frames per packet.
+ * @return                          Size of a packet holding `frames_per_packet` frames
+ *                                  of `AMR_WB_MODE_23850bps`.
+ */
+int amr_wb_rtp_get_max_packet_size(int payload_format, int frames_per_packet);
+
+/**
+ * @brief Initializes a packer.
+ *
+ * @param[in] packer                The packer.
+ * @param[in] payload_format        `AMR_WB_RTP_OCTET_ALIGNED` or `AMR_WB_RTP_BANDWIDTH_EFFICIENT`.
+ * @param[in] frames_per_packet     Number of frames per packet (1 ~ 12).
+ * @return                          0 if succeeded else -1.
+ */
+int amr_wb_rtp_packer_init(struct amr_wb_rtp_packer *packer, int payload_format, int frames_per_packet);
+
+/**
+ * @brief Starts a new packet.
+ *
+ * The packet is written into `packet` directly, frame by frame.
+ *
+ * @param[in] packer                The packer.
+ * @param[out] packet               The packet buffer.
+ * @param[in] capacity              Size of the packet buffer in bytes.
+ * @param[in] cmr                   Codec mode request to the peer
+ *                                  (`AMR_WB_MODE_xxx` or `AMR_WB_CMR_NO_REQUEST`).
+ * @return                          0 if succeeded else -1.
+ */
+int amr_wb_rtp_packer_begin(struct amr_wb_rtp_packer *packer, uint8_t *packet, int capacity, int cmr);
+
+/**
+ * @brief Adds a frame to current packet.
+ *
+ * Example:
+ *
+ * ```c
+ * amr_wb_rtp_packer_begin(&packer, packet, sizeof(packet), cmr);
+ * for (i = 0; i < frames_per_packet; i++)
+ * {
+ *     amr_wb_encoder_encode_frame2(enc, mode, pcm + i * AMR_WB_PCM_FRAME_16k, frame, scratch);
+ *     amr_wb_rtp_packer_add_frame(&packer, frame);
+ * }
+ * len = amr_wb_rtp_packer_finish(&packer);
+ * ```
+ *
+ * @param[in] packer                The packer.
+ * @param[in] frame                 A frame in `AMR_WB_BIT_STREAM_FORMAT_MIME_IETF` format
+ *                                  (header + payload).
+ * @return                          Number of frames that can still be added (0 means that
+ *                                  the packet is full), or -1 if the packet buffer is too
+ *                                  small or the packet is already full.
+ */
+int amr_wb_rtp_packer_add_frame(struct amr_wb_rtp_packer *packer, const uint8_t *frame);
+
+/**
+ * @brief Finishes current packet.
+ *
+ * If less than `frames_per_packet` frames are added, the packet is filled up with
+ * NO_DATA frames.
+ *
+ * @param[in] packer                The packer.
+ * @return                          Length of the packet in bytes, or -1 if the packet
+ *                                  buffer is too small.
+ */
+int amr_wb_rtp_packer_finish(struct amr_wb_rtp_packer *packer);
+
+/**
+ * @brief Unpacks a RTP payload into MIME/IETF frames.
+ *
+ * Frames are written one after another (header + payload) into `frames`,
+ * i.e. in the same layout as a MIME/IETF stream without the magic.
+ * A frame of a reserved type has no known length, so it and all frames after
+ * it in the packet are replaced by NO_DATA frames; `frame_num` still counts them.
+ *
+ * @param[in] packet                The RTP payload.
+ * @param[in] len                   Length of the RTP payload in bytes.
+ * @param[in] payload_format        `AMR_WB_RTP_OCTET_ALIGNED` or `AMR_WB_RTP_BANDWIDTH_EFFICIENT`.
+ * @param[out] cmr                  Codec mode request from the peer (optional, can be NULL).
+ * @param[out] frames               Buffer for the frames.
+ * @param[in] capacity              Size of `frames` in bytes.
+ * @param[out] frame_num            Number of frames (optional, can be NULL).
+ * @return                          Number of bytes written into `frames`,
+ *                                  or -1 if the packet is malformed or `frames` is too small.
+ */
+int amr_wb_rtp_depacketize(const uint8_t *packet, int len, int payload_format, int *cmr,
+                           uint8_t *frames, int capacity, int *frame_num);
+
+/**@}*/
+
+/**
+ * @defgroup AMR-WB rate adaptation
+ *
+ * Selects the encoding mode for each frame from:
+ *
+ * 1. Codec mode request (CMR) from the peer, which caps the mode;
+ * 1. Packet loss and jitter observed locally;
+ * 1. Depth of the local TX queue.
+ *
+ * Mode goes down fast when the link degrades, and goes up one step at a time,
+ * only after the link stays good for a while (hysteresis). Loss and jitter also
+ * decide the CMR sent to the peer.
+ *
+ * Example:
+ *
+ * ```c
+ * struct amr_wb_rate_ctrl ctrl;
+ * amr_wb_rate_ctrl_init(&ctrl, AMR_WB_MODE_12650bps, AMR_WB_MODE_6600bps, AMR_WB_MODE_23850bps);
+ *
+ * // on each received packet:
+ * amr_wb_rtp_depacketize(packet, len, format, &cmr, frames, sizeof(frames), NULL);
+ * amr_wb_rate_ctrl_on_peer_cmr(&ctrl, cmr);
+ *
+ * // on each report from jitter buffer (every 100ms, for example):
+ * amr_wb_rate_ctrl_report_rx(&ctrl, received, lost, jitter_ms);
+ *
+ * // on each frame to be sent:
+ * amr_wb_rate_ctrl_report_tx_queue(&ctrl, queued_frames);
+ * mode = amr_wb_rate_ctrl_next_mode(&ctrl);
+ * amr_wb_encoder_encode_frame2(enc, mode, pcm, frame, scratch);
+ * amr_wb_rtp_packer_begin(&packer, packet, sizeof(packet), amr_wb_rate_ctrl_get_cmr(&ctrl));
+ * ```
+ */
+/**@{*/
+
+struct amr_wb_rate_state
+{
+    int8_t mode;
+    uint16_t good_cnt;
+    uint16_t since_down;
+};
+
+/**
+ * @brief Rate controller.
+ *
+ * Thresholds are set to defaults by `amr_wb_rate_ctrl_init`, and can be tuned
+ * afterwards. Other fields are internal.
+ */
+struct amr_wb_rate_ctrl
+{
+    int8_t min_mode;
+    int8_t max_mode;
+    uint16_t loss_high;         // smoothed loss (in permille) above which mode goes down
+    uint16_t loss_low;          // smoothed loss (in permille) below which mode may go up
+    uint16_t jitter_high;       // smoothed jitter (in ms) above which mode goes down
+    uint16_t jitter_low;        // smoothed jitter (in ms) below which mode may go up
+    uint16_t queue_high;        // TX queue depth (in frames) above which mode goes down
+    uint16_t queue_low;         // TX queue depth (in frames) below which mode may go up
+    uint16_t up_hold;           // frames of good conditions before going up by one step
+    uint16_t down_hold;         // minimum frames between two steps down
+
+    int8_t peer_cmr;
+    uint16_t loss;              // permille
+    uint16_t jitter;            // ms, Q4
+    uint16_t queue;
+    struct amr_wb_rate_state tx;
+    struct amr_wb_rate_state link;
+};
+
+/**
+ * @brief Initializes a rate controller.
+ *
+ * @param[in] ctrl          The rate controller.
+ * @param[in] initial_mode  Initial mode (See `AMR_WB_MODE_xxx`).
+ * @param[in] min_mode      Minimum mode allowed.
+ * @param[in] max_mode      Maximum mode allowed.
+ */
+void amr_wb_rate_ctrl_init(struct amr_wb_rate_ctrl *ctrl, int initial_mode, int min_mode, int max_mode);
+
+/**
+ * @brief Reports a CMR received from the peer.
+ *
+ * @param[in] ctrl          The rate controller.
+ * @param[in] cmr           CMR (`AMR_WB_MODE_xxx` or `AMR_WB_CMR_NO_REQUEST`).
+ */
+void amr_wb_rate_ctrl_on_peer_cmr(struct amr_wb_rate_ctrl *ctrl, int cmr);
+
+/**
+ * @brief Reports RX statistics of a period.
+ *
+ * @param[in] ctrl          The rate controller.
+ * @param[in] received      Number of frames received in this period.
+ * @param[in] lost          Number of frames lost (or arrived too late) in this period.
+ * @param[in] jitter_ms     Jitter observed in this period (in ms).
+ */
+void amr_wb_rate_ctrl_report_rx(struct amr_wb_rate_ctrl *ctrl, int received, int lost, int jitter_ms);
+
+/**
+ * @brief Reports the depth of TX queue.
+ *
+ * @param[in] ctrl          The rate controller.
+ * @param[in] frames        Number of frames waiting to be sent.
+ */
+void amr_wb_rate_ctrl_report_tx_queue(struct amr_wb_rate_ctrl *ctrl, int frames);
+
+/**
+ * @brief Gets the mode for the next frame.
+ *
+ * This function must be called once per frame (i.e. every 20ms).
+ *
+ * @param[in] ctrl          The rate controller.
+ * @return                  Mode for the next frame (See `AMR_WB_MODE_xxx`).
+ */
+int amr_wb_rate_ctrl_next_mode(struct amr_wb_rate_ctrl *ctrl);
+
+/**
+ * @brief Gets the CMR to be sent to the peer.
+ *
+ * @param[in] ctrl          The rate controller.
+ * @return                  CMR (`AMR_WB_MODE_xxx` or `AMR_WB_CMR_NO_REQUEST`).
+ */
+int amr_wb_rate_ctrl_get_cmr(const struct amr_wb_rate_ctrl *ctrl);
+
 /**@}*/
 
 #ifdef __cplusplus
@@ -72,6 +72,9 @@ int stretch_get_context_size(int sampling_rate, int lower_freq, int upper_freq,
  *
  * @note The buffer provided in `buf` should be appropriately allocated by the caller, the size
  * of which can be got by `stretch_get_context_size(sampling_rate, lower_freq, upper_freq, flags)`.
+ *
+ * @warning This function uses a global allocator internally, so contexts must not be
+ * initialized concurrently. Initialized contexts are independent of each other.
  */
 struct stretch_ctx_t *stretch_init(int sampling_rate, int lower_freq, int upper_freq, int flags, void *buf);
 
@@ -10,6 +10,28 @@ extern "C"
 
 #define TTS_SAMPLE_RATE     (16000)
 
+/**
+ * Thread safety
+ *
+ * The engine has no global state: all states of a TTS session live in its
+ * context, scratch memory, and (if used) unit cache and synthesizer. So,
+ * contexts can be used concurrently on different threads:
+ *
+ * - A voice definition is read-only, and can be shared by any number of contexts;
+ * - Compiled templates (`tts_compile_template`) are read-only, and can be
+ *   shared by contexts of the same voice;
+ * - Scratch memory 1 & 2 belong to a context while it is synthesizing.
+ *   Contexts that never synthesize at the same time (e.g. used one after
+ *   another on the same thread) can share scratch memory;
+ * - A unit cache belongs to a single context;
+ * - A context must not be used by two threads at the same time, except that
+ *   `tts_abort` can be called from any thread or ISR.
+ *
+ * Caution: pinyin quoted with `[]` is tokenized with `strtok` of the C library.
+ * If `strtok` of the C library is not thread safe (such as newlib built without
+ * per-thread reentrancy), pushing texts containing `[]` must be serialized.
+ */
+
 struct voice_definition;
 struct tts_context;
 
@@ -195,6 +217,14 @@ int tts_synthesize(struct tts_context *ctx, f_tts_receive_pcm_samples rx_samples
  *
  * This function works asynchronously: it sets an internal abort flag to true, and returns.
  *
+ * Worst-case stop latency, i.e. samples output after this function returns:
+ * - `tts_synthesize_stream`, `tts_synthesize_window` and `tts_synthesize_cached`
+ *   check the flag after each frame is delivered: at most one frame
+ *   (`AMR_WB_PCM_FRAME_16k` samples) plus the one being delivered;
+ * - `tts_synth_step` checks the flag on each call: the samples of the call
+ *   in progress (at most `max_samples`), plus the fade-out (see
+ *   `tts_synth_set_fade_out`). Call it with fewer samples for a finer granularity.
+ *
  * @param ctx Pointer to the TTS context structure.
  */
 void tts_abort(struct tts_context *ctx);
@@ -287,6 +317,829 @@ void tts_synthesizer_restart(struct tts_synthesizer *synthesizer);
  */
 void tts_tune(struct tts_context *ctx, uint8_t tune);
 
+// The APIs below are not in the prebuilt libraries: compile `src/tts` with the
+// application (see `src/libaudio.mk`). They access the TTS context and voice
+// definitions by the private layouts of `src/tts/tts_priv.h` and
+// `src/amr_wb/amr_wb_priv.h`, so they are only valid with the prebuilt
+// libraries of the same release of this repository.
+
+struct tts_unit_cache;
+
+/**
+ * @brief Statistics of a unit cache.
+ */
+struct tts_unit_cache_stats
+{
+    uint32_t hits;              // units played from the cache
+    uint32_t misses;            // units decoded
+    uint32_t evictions;         // units evicted to make room for others
+    uint32_t uncacheable;       // units that are longer than the whole cache
+    int used_frames;            // frames currently in use
+};
+
+/**
+ * @brief Retrieves the size of a unit cache.
+ *
+ * A unit cache keeps decoded PCM samples of recently synthesized units, so
+ * that frequent syllables (such as digits and currency words) are played
+ * without being decoded again.
+ *
+ * Memory is allocated in frames (`AMR_WB_PCM_FRAME_16k` samples, 20ms).
+ * A unit is typically 10~30 frames long.
+ *
+ * @param[in] frames        Capacity of the cache in frames (1..65534).
+ *
+ * @return The size of the cache in bytes, or 0 if `frames` is out of range.
+ */
+int tts_get_unit_cache_size(int frames);
+
+/**
+ * @brief Initializes a unit cache.
+ *
+ * To destroy the cache, just free the buffer (`buf`).
+ *
+ * @param[in] frames        Capacity of the cache in frames.
+ * @param[in] buf           Buffer of `tts_get_unit_cache_size(frames)` bytes.
+ *
+ * @return A pointer to the initialized cache, or NULL on failure.
+ *
+ * @note A cache belongs to a single TTS context. When the voice of the context
+ *       changes, the cache is cleared automatically.
+ */
+struct tts_unit_cache *tts_unit_cache_init(int frames, void *buf);
+
+/**
+ * @brief Removes all units from a unit cache.
+ *
+ * Statistics are kept.
+ *
+ * @param[in] cache         Pointer to the unit cache.
+ */
+void tts_unit_cache_clear(struct tts_unit_cache *cache);
+
+/**
+ * @brief Gets the statistics of a unit cache.
+ *
+ * @param[in] cache         Pointer to the unit cache.
+ * @param[out] stats        Statistics.
+ */
+void tts_unit_cache_get_stats(const struct tts_unit_cache *cache, struct tts_unit_cache_stats *stats);
+
+/**
+ * @brief Resets the counters of a unit cache.
+ *
+ * @param[in] cache         Pointer to the unit cache.
+ */
+void tts_unit_cache_reset_stats(struct tts_unit_cache *cache);
+
+/**
+ * @brief Typedef for a function pointer that reads a free running clock.
+ *
+ * Any unit can be used, such as DWT CYCCNT on Cortex-M4, or microseconds
+ * from `clock_gettime` on a host. Wrap-around is handled.
+ *
+ * @return                  Current time.
+ */
+typedef uint32_t (*f_tts_clock)(void);
+
+/**
+ * @brief Profiling statistics of synthesis.
+ *
+ * Filled by `tts_synthesize_cached`, `tts_synthesize_stream` and
+ * `tts_synthesize_window` (method #1) and by `tts_synth_get_stats` (method #3).
+ * Times are measured with the given clock (`tts_synth_set_clock` for method #3),
+ * and are 0 if no clock is given.
+ *
+ * For method #3, counters keep running across `tts_synth_restart`, until
+ * `tts_synth_reset_stats`.
+ */
+struct tts_stats
+{
+    uint32_t lookup_time;       // finding units: unit cache, prefetcher, skipping trimmed heads
+    uint32_t decode_time;       // decoding of AMR-WB frames
+    uint32_t output_time;       // resampling, change of speed, and copying samples to the output (method #3)
+    int units;                  // units played, silence excluded
+    int cache_hits;             // units played from the unit cache
+    int missing_units;          // units missing from the voice definition (see `tts_synth_set_missing_unit`)
+    int decoded_frames;         // frames decoded
+    int samples;                // samples output
+    uint32_t flash_bytes;       // bytes of units read from the voice definition, not through the prefetcher
+    uint32_t analysis_time;     // text analysis, only when the function pushes the text itself
+                                // (`tts_synthesize_stream`, `tts_synthesize_window`)
+};
+
+/**
+ * @brief (Method #1) Synthesizes text-to-speech (TTS) audio with a unit cache.
+ *
+ * This function is the same as `tts_synthesize`, except that units found in
+ * `cache` are not decoded, and decoded units are added into `cache`.
+ * PCM samples are identical to those of `tts_synthesize`.
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] cache         Pointer to the unit cache.
+ * @param[in] rx_samples    Callback function to receive PCM samples.
+ *                          When a non-0 value is returned by `rx_samples`, synthesis is aborted.
+ * @param[in] user_data     User-provided data to be passed to the callback function.
+ * @param[in] scratch1      Scratch memory 1 for internal use during synthesis.
+ * @param[in] scratch2      Scratch memory 2 for internal use during synthesis.
+ * @param[in] clock         Clock for statistics (optional, can be NULL).
+ * @param[out] stats        Statistics (optional, can be NULL).
+ *
+ * @return Returns 0 on success, or non-0 error code on failure.
+ *
+ * @note `pcm_samples` passed to `rx_samples` may point into the cache, and
+ *       must not be modified.
+ */
+int tts_synthesize_cached(struct tts_context *ctx, struct tts_unit_cache *cache,
+    f_tts_receive_pcm_samples rx_samples, void *user_data, void *scratch1, void *scratch2,
+    f_tts_clock clock, struct tts_stats *stats);
+
+/**
+ * @brief Statistics of streaming synthesis.
+ *
+ * Times are measured with the clock given to `tts_synthesize_stream`, and are
+ * 0 if no clock is given.
+ */
+struct tts_stream_stats
+{
+    uint32_t time_to_first_sample;  // from the call until the first samples are delivered
+    uint32_t analysis_time;         // time spent in text analysis (all phrases)
+    uint32_t total_time;            // time of the whole call
+    int phrases;                    // number of phrases
+    int syllables;                  // number of syllables
+    int samples;                    // number of samples delivered
+    struct tts_stats synth;         // statistics of each stage of synthesis
+};
+
+/**
+ * @brief Pushes the first phrase of a UTF-8 encoded string to current TTS session.
+ *
+ * A phrase ends after punctuations (such as `，` `。` `,` `.`) or a new line.
+ * Separators within numbers (such as `1,000.50`) and pinyin quoted by `[]` do
+ * not end a phrase. A phrase longer than 120 bytes is split. At least one
+ * character is pushed, unless `utf8_str` is empty.
+ *
+ * @param ctx               Pointer to the TTS context structure.
+ * @param utf8_str          Pointer to the null-terminated UTF-8 encoded string.
+ *
+ * @return The remaining part of `utf8_str`, or NULL if the phrase can't be pushed.
+ */
+const char *tts_push_utf8_phrase(struct tts_context *ctx, const char *utf8_str);
+
+/**
+ * @brief (Method #1) Synthesizes a text phrase by phrase.
+ *
+ * The context is reset, then the text is analyzed one phrase at a time: the
+ * first phrase is analyzed and its audio is delivered before the next
+ * phrase is analyzed. Compared with pushing the whole text and then calling
+ * `tts_synthesize`, the first samples are available much earlier for long texts.
+ *
+ * Syllables of all phrases are kept in the context, so `max_syllables` of
+ * the context still limits the length of the text.
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] utf8_str      Pointer to the null-terminated UTF-8 encoded text.
+ * @param[in] cache         Pointer to a unit cache (optional, can be NULL).
+ * @param[in] rx_samples    Callback function to receive PCM samples.
+ *                          When a non-0 value is returned by `rx_samples`, synthesis is aborted.
+ * @param[in] user_data     User-provided data to be passed to the callback function.
+ * @param[in] scratch1      Scratch memory 1 for internal use during synthesis.
+ * @param[in] scratch2      Scratch memory 2 for internal use during synthesis.
+ * @param[in] clock         Clock for statistics (optional, can be NULL).
+ * @param[out] stats        Statistics (optional, can be NULL).
+ *
+ * @return Returns 0 on success, -1 if a phrase can't be pushed (e.g. too
+ *         many syllables), or the non-0 value returned by `rx_samples`.
+ */
+int tts_synthesize_stream(struct tts_context *ctx, const char *utf8_str, struct tts_unit_cache *cache,
+    f_tts_receive_pcm_samples rx_samples, void *user_data, void *scratch1, void *scratch2,
+    f_tts_clock clock, struct tts_stream_stats *stats);
+
+struct tts_synth;
+
+/**
+ * @brief (Method #3) Retrieves the size of a resumable synthesizer.
+ *
+ * @return The size of the synthesizer in bytes.
+ */
+int tts_synth_get_size(void);
+
+/**
+ * @brief (Method #3) Initializes a resumable synthesizer.
+ *
+ * Unlike method #2, all states of the synthesizer live in `buf`, so that
+ * synthesis can be driven by an event loop or a timer, one step at a time.
+ *
+ * `scratch1` and `scratch2` belong to the synthesizer until synthesis
+ * completes or is aborted.
+ *
+ * To destroy the synthesizer, just free the buffer (`buf`).
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] cache         Pointer to a unit cache (optional, can be NULL).
+ * @param[in] scratch1      Scratch memory 1 for internal use during synthesis.
+ * @param[in] scratch2      Scratch memory 2 for internal use during synthesis.
+ * @param[in] buf           Buffer of `tts_synth_get_size()` bytes.
+ *
+ * @return A pointer to the initialized synthesizer.
+ */
+struct tts_synth *tts_synth_init(struct tts_context *ctx, struct tts_unit_cache *cache,
+                                 void *scratch1, void *scratch2, void *buf);
+
+/**
+ * @brief (Method #3) Synthesizes a number of samples.
+ *
+ * Each call does a bounded amount of work: at most one frame
+ * (`AMR_WB_PCM_FRAME_16k` samples) is decoded, and at most one frame of
+ * samples is output (up to 3 frames if speed is changed, see `tts_synth_set_speed`).
+ * Frames are 20ms at the output sample rate (see `tts_synth_set_output_rate`).
+ *
+ * Syllables pushed to the context after the synthesizer has caught up are
+ * synthesized by following calls.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[out] out          Output buffer.
+ * @param[in] max_samples   Capacity of `out` in samples.
+ *
+ * @return Number of samples stored in `out` (1 ~ `max_samples`),
+ *         or 0 if all syllables are synthesized or synthesis is aborted (`tts_abort`)
+ *         and faded out.
+ */
+int tts_synth_step(struct tts_synth *synth, int16_t *out, int max_samples);
+
+/**
+ * @brief (Method #3) Restarts a resumable synthesizer from the beginning.
+ *
+ * The abort flag is cleared. Speed, output sample rate, fade-out and statistics are kept.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ */
+void tts_synth_restart(struct tts_synth *synth);
+
+/**
+ * @brief (Method #3) Sets the fade-out when synthesis is aborted.
+ *
+ * Once `tts_synth_step` sees the abort flag, the rest of the frame being
+ * output is ramped down to 0 over up to `samples` samples, so that the cut
+ * is click-free. Beyond the end of the frame, nothing is output. If the flag
+ * is seen between two frames, one more frame is decoded to be faded out.
+ *
+ * 5ms (e.g. 80 samples at 16kHz) is enough to avoid a click. The fade-out of
+ * a new synthesizer is 0: synthesis stops at once.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] samples       Length of fade-out in samples at the output sample rate.
+ */
+void tts_synth_set_fade_out(struct tts_synth *synth, int samples);
+
+/**
+ * @brief (Method #3) Aborts synthesis and restarts with a new text.
+ *
+ * The speech being output is faded out as if aborted (see `tts_synth_set_fade_out`),
+ * the context is reset, and `utf8_str` is pushed to it. Following calls of
+ * `tts_synth_step` output the rest of the fade-out, then the new text,
+ * without returning 0 in between.
+ *
+ * Like `tts_synth_restart`, speed, output sample rate, fade-out, statistics,
+ * the prefetcher and units in the unit cache are kept.
+ *
+ * Unlike `tts_abort`, this must be called from the thread calling `tts_synth_step`.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] utf8_str      New text (see `tts_push_utf8_str`).
+ *
+ * @return Returns 0 on success, or the error code of `tts_push_utf8_str`.
+ */
+int tts_synth_preempt(struct tts_synth *synth, const char *utf8_str);
+
+// Speed in Q8
+#define TTS_SPEED_NORMAL            256
+#define TTS_SPEED_MIN               128 // x0.5
+#define TTS_SPEED_MAX               512 // x2.0
+
+/**
+ * @brief (Method #3) Sets speed of speech.
+ *
+ * Speed is changed while units are concatenated, using pitch periods known
+ * by the speech decoder (refined by a short correlation search at the output
+ * rate): whole periods are dropped or repeated with cross-fading, and silence
+ * is shortened or lengthened. Pitch is not changed.
+ *
+ * This replaces a separate time-stretcher (`stretch.h`) after synthesis:
+ * neither its context nor its output buffer is needed (scratch memory 2 is
+ * used instead), and pitch is not detected again.
+ *
+ * Speed can be changed at any time, and takes effect from the next frame.
+ * Speed of a new synthesizer is `TTS_SPEED_NORMAL`, which outputs exactly
+ * the same samples as other methods.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] speed         Speed in Q8 (256: normal), clamped to
+ *                          [`TTS_SPEED_MIN`, `TTS_SPEED_MAX`].
+ */
+void tts_synth_set_speed(struct tts_synth *synth, int speed);
+
+/**
+ * @brief (Method #3) Sets the output sample rate.
+ *
+ * Units are decoded at `TTS_SAMPLE_RATE`, and each frame is converted with
+ * `struct amr_wb_resampler` in scratch memory 2 before it is output, so
+ * no separate resampler stage or buffer is needed. 48kHz is an exact 3x
+ * interpolation, and 8kHz is a 2x decimation which also halves the work of
+ * changing speed and copying samples.
+ *
+ * Speed is changed after resampling. At 44.1kHz and 48kHz, a frame can't
+ * grow beyond scratch memory 2, so the slowest speed is about x0.52.
+ *
+ * The rate of a new synthesizer is `TTS_SAMPLE_RATE`. SBC and Opus of `tts_encoder`
+ * need `TTS_SAMPLE_RATE`.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] rate          Output sample rate: 8000, 16000, 44100 or 48000.
+ *
+ * @return 0 if succeeded else -1 (sample rate not supported).
+ */
+int tts_synth_set_output_rate(struct tts_synth *synth, int rate);
+
+struct tts_prefetch;
+
+// Maximum number of units fetched ahead
+#define TTS_PREFETCH_MAX_DEPTH      3
+
+/**
+ * @brief A function pointer type to start copying data of a unit from flash to RAM.
+ *
+ * Copying can be asynchronous (e.g. by DMA). When it completes,
+ * `tts_prefetch_complete` must be called, which may be called from an ISR,
+ * or even before this function returns. Only one copy is in progress at a time.
+ *
+ * @param[out] dst          Destination in RAM.
+ * @param[in] src           Source in flash (within the voice definition).
+ * @param[in] size          Number of bytes.
+ * @param[in] user_data     User data given to `tts_prefetch_init`.
+ *
+ * @return 0 if copying is started, otherwise non-zero (the unit is read from flash directly).
+ */
+typedef int (*f_tts_fetch)(void *dst, const void *src, int size, void *user_data);
+
+/**
+ * @brief (Method #3) Retrieves the size of a prefetcher.
+ *
+ * When the voice definition is read through XIP (such as at `AHB_QSPI_MEM_BASE`),
+ * each flash cache miss stalls decoding. A prefetcher copies units of the next
+ * `depth` syllables into a ring in RAM while the current unit is decoded.
+ *
+ * The returned size is enough to hold any `depth + 1` units of the voice.
+ * A smaller size can also be used, in which case units that do not fit are
+ * read from flash directly.
+ *
+ * @param[in] voice         Pointer to the voice definition.
+ * @param[in] depth         Number of units fetched ahead (1..`TTS_PREFETCH_MAX_DEPTH`).
+ *
+ * @return The size in bytes, or 0 if `depth` is out of range.
+ */
+int tts_get_prefetch_size(const struct voice_definition *voice, int depth);
+
+/**
+ * @brief (Method #3) Initializes a prefetcher.
+ *
+ * To destroy the prefetcher, just free the buffer (`buf`), after the last
+ * copy has completed.
+ *
+ * @param[in] size          Size of `buf` in bytes.
+ * @param[in] depth         Number of units fetched ahead (1..`TTS_PREFETCH_MAX_DEPTH`).
+ * @param[in] fetch         Callback to start copying.
+ * @param[in] user_data     User data passed to `fetch`.
+ * @param[in] buf           Buffer of `size` bytes.
+ *
+ * @return A pointer to the initialized prefetcher, or NULL if parameters are invalid.
+ */
+struct tts_prefetch *tts_prefetch_init(int size, int depth, f_tts_fetch fetch, void *user_data, void *buf);
+
+/**
+ * @brief Notifies a prefetcher that copying has completed.
+ *
+ * @param[in] prefetch      Pointer to the prefetcher.
+ */
+void tts_prefetch_complete(struct tts_prefetch *prefetch);
+
+/**
+ * @brief (Method #3) Lets a synthesizer read units through a prefetcher.
+ *
+ * Units are then fetched while `tts_synth_step` is called. A unit that has
+ * not arrived when it is needed is read from flash directly, so output is
+ * always the same as without a prefetcher.
+ *
+ * The prefetcher is kept when the synthesizer is restarted. A prefetcher
+ * serves one synthesizer at a time.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] prefetch      Pointer to the prefetcher, or NULL to disable prefetching.
+ */
+void tts_synth_set_prefetch(struct tts_synth *synth, struct tts_prefetch *prefetch);
+
+// Actions on units missing from a subset voice definition
+#define TTS_MISSING_UNIT_SKIP       0   // nothing is played (all methods)
+#define TTS_MISSING_UNIT_BEEP       1   // a beep of 160ms is played
+
+/**
+ * @brief (Method #3) Sets how units missing from the voice definition are played.
+ *
+ * A subset voice definition (see `tools/voice_subset`) only contains units
+ * needed by a product. Other units are empty. By default, and in other
+ * methods, they are skipped.
+ *
+ * The action is kept when the synthesizer is restarted.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] action        `TTS_MISSING_UNIT_SKIP` or `TTS_MISSING_UNIT_BEEP`.
+ */
+void tts_synth_set_missing_unit(struct tts_synth *synth, int action);
+
+/**
+ * @brief (Method #3) Sets the clock to measure times of `struct tts_stats`.
+ *
+ * The clock is read a few times per frame.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[in] clock         Clock, such as DWT CYCCNT (can be NULL: times are not measured).
+ */
+void tts_synth_set_clock(struct tts_synth *synth, f_tts_clock clock);
+
+/**
+ * @brief (Method #3) Gets the profiling statistics of a synthesizer.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ * @param[out] stats        Statistics.
+ */
+void tts_synth_get_stats(const struct tts_synth *synth, struct tts_stats *stats);
+
+/**
+ * @brief (Method #3) Resets the profiling statistics of a synthesizer.
+ *
+ * @param[in] synth         Pointer to the synthesizer.
+ */
+void tts_synth_reset_stats(struct tts_synth *synth);
+
+struct tts_encoder;
+struct sbc_frame;
+struct OpusEncoder;
+
+#define TTS_CODEC_ADPCM             0   // IMA ADPCM (`audio_adpcm.h`), 2 samples per byte
+#define TTS_CODEC_SBC               1   // SBC or mSBC (`sbc.h`), 16kHz mono
+#define TTS_CODEC_OPUS              2   // Opus (`opus.h`)
+
+/**
+ * @brief Configuration of an encoder of synthesized speech.
+ */
+struct tts_encoder_config
+{
+    int codec;                          // TTS_CODEC_xxx
+    int frame_samples;                  // samples per frame: any even number for ADPCM;
+                                        // 40, 80, 160, 320, 640 or 960 (2.5ms ~ 60ms) for Opus;
+                                        // ignored for SBC (`nblocks` * `nsubbands`)
+    const struct sbc_frame *sbc;        // SBC: frame description (`msbc` for mSBC)
+    struct OpusEncoder *opus;           // Opus: an initialized encoder of 16kHz, 1 channel
+    int max_frame_bytes;                // Opus: capacity of a packet
+};
+
+/**
+ * @brief Typedef for a function pointer that receives encoded frames.
+ *
+ * @param[in] frame         An encoded frame (a packet for Opus).
+ * @param[in] size          Size of the frame in bytes.
+ * @param[in] user_data     User-provided data.
+ *
+ * @return 0 to continue, or non-0 value to stop synthesis.
+ */
+typedef int (*f_tts_receive_frame)(const uint8_t *frame, int size, void *user_data);
+
+/**
+ * @brief Retrieves the size of an encoder of synthesized speech.
+ *
+ * @param[in] config        Configuration.
+ *
+ * @return The size of the encoder in bytes, or 0 if the configuration is invalid.
+ */
+int tts_encoder_get_size(const struct tts_encoder_config *config);
+
+/**
+ * @brief Initializes an encoder of synthesized speech.
+ *
+ * The encoder buffers samples to frames of the codec, and delivers each
+ * frame to `rx_frame` as soon as it is encoded, so the application neither
+ * buffers PCM samples nor calls the codec.
+ *
+ * SBC uses a part of scratch memory 2 for encoding, which is free while a
+ * frame is encoded, with any method of synthesis. Other codecs do not touch it.
+ *
+ * Initialize the encoder again for each text.
+ *
+ * @param[in] config        Configuration (not referenced after this call).
+ * @param[in] rx_frame      Callback function to receive encoded frames.
+ * @param[in] user_data     User-provided data to be passed to `rx_frame`.
+ * @param[in] scratch2      Scratch memory 2 of synthesis.
+ * @param[in] buf           Buffer of `tts_encoder_get_size(config)` bytes.
+ *
+ * @return A pointer to the initialized encoder, or NULL if the configuration is invalid.
+ */
+struct tts_encoder *tts_encoder_init(const struct tts_encoder_config *config,
+    f_tts_receive_frame rx_frame, void *user_data, void *scratch2, void *buf);
+
+/**
+ * @brief (Method #1) Receives PCM samples, and delivers encoded frames.
+ *
+ * This is a `f_tts_receive_pcm_samples`: pass it to `tts_synthesize`,
+ * `tts_synthesize_stream` and so on, with the encoder as `user_data`.
+ * Call `tts_encoder_flush` after synthesis.
+ *
+ * @return 0, -1 if encoding fails, or the non-0 value returned by `rx_frame`.
+ */
+int tts_encoder_receive_pcm(struct tts_context *ctx, const int16_t *pcm_samples, int number,
+                            int acc_number, void *user_data);
+
+/**
+ * @brief (Method #1) Delivers the last frame, padded with silence.
+ *
+ * @param[in] encoder       Pointer to the encoder.
+ *
+ * @return 0, -1 if encoding fails, or the non-0 value returned by `rx_frame`.
+ */
+int tts_encoder_flush(struct tts_encoder *encoder);
+
+/**
+ * @brief (Method #3) Synthesizes and delivers a frame.
+ *
+ * Samples are synthesized into the frame buffer of the encoder directly.
+ * A frame longer than `AMR_WB_PCM_FRAME_16k` samples needs more than one
+ * step of `synth`.
+ *
+ * When `synth` has no more samples (all pushed syllables are synthesized,
+ * or synthesis is aborted), samples of a partial frame are kept, so that
+ * text pushed later continues the frame without a gap. Call
+ * `tts_encoder_flush` at the end of speech to deliver the last frame,
+ * padded with silence.
+ *
+ * SBC and Opus need the output rate of `synth` to be `TTS_SAMPLE_RATE`.
+ *
+ * @param[in] encoder       Pointer to the encoder.
+ * @param[in] synth         Pointer to the synthesizer.
+ *
+ * @return 1 if a frame is delivered, 0 if `synth` has no more samples, or
+ *         -1 if encoding fails, `rx_frame` returns non-0, or the output rate
+ *         of `synth` does not suit the codec.
+ */
+int tts_encoder_step(struct tts_encoder *encoder, struct tts_synth *synth);
+
+// Types of template slots
+#define TTS_SLOT_INTEGER            0   // `{int}`: int64_t
+#define TTS_SLOT_YUAN_JIAO_FEN      1   // `{money}`: int64_t yuan, int jiao, int fen
+#define TTS_SLOT_UTF8_STR           2   // `{text}`: const char *
+
+struct tts_template;
+
+/**
+ * @brief Compiles a prompt template into a sequence of syllables.
+ *
+ * Fixed text of a template is analyzed once here, and slots are filled by
+ * `tts_push_template` when the prompt is spoken. For example:
+ *
+ * ```
+ * "支付宝收款{amount:money}，谢谢"
+ * ```
+ *
+ * A slot is written as `{type}` or `{name:type}`, where `type` is one of
+ * `int`, `money` and `text`. Up to 16 slots are supported.
+ *
+ * @param[in] ctx           Pointer to the TTS context used for analysis.
+ *                          The context is reset, and is left empty on return.
+ * @param[in] template_str  Pointer to the null-terminated UTF-8 encoded template.
+ * @param[out] buf          Buffer (4-byte aligned) to store the compiled template,
+ *                          or NULL to get the required size.
+ * @param[in] buf_size      Size of `buf` in bytes.
+ *
+ * @return Size of the compiled template in bytes, or -1 on error (bad slot,
+ *         too many syllables, or `buf` too small).
+ *
+ * @note The compiled template depends on the voice of `ctx`, and can be
+ *       stored (e.g. in flash) and used with any context of the same voice.
+ */
+int tts_compile_template(struct tts_context *ctx, const char *template_str, void *buf, int buf_size);
+
+/**
+ * @brief Pushes a compiled template to current TTS session.
+ *
+ * Slot values follow `tpl` in the order of slots. Note that integers are of
+ * type `int64_t`:
+ *
+ * ```
+ * tts_push_template(ctx, tpl, (int64_t)12, 3, 4);  // {money}: 12.34 元
+ * ```
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] tpl           Compiled template (`tts_compile_template`).
+ *
+ * @return Returns 0 on success, or non-0 error code if the operation fails.
+ */
+int tts_push_template(struct tts_context *ctx, const struct tts_template *tpl, ...);
+
+/**
+ * @brief Typedef for a function pointer that reads text to be synthesized.
+ *
+ * Text can be delivered in pieces of any size, and a UTF-8 character may be
+ * split between two calls.
+ *
+ * @param[out] buf          Buffer to store UTF-8 encoded text.
+ * @param[in] size          Capacity of `buf` in bytes.
+ * @param[in] user_data     User-provided data.
+ *
+ * @return Number of bytes stored in `buf`, or 0 at the end of text.
+ */
+typedef int (*f_tts_read_text)(char *buf, int size, void *user_data);
+
+/**
+ * @brief (Method #1) Synthesizes a text of any length with a sliding window.
+ *
+ * Text is read from `reader` one phrase at a time, and the context only holds
+ * the syllables of the current phrase, so the memory of the context does not
+ * depend on the length of the text. `max_syllables` of about 64 is enough for
+ * most texts. A phrase that has more syllables than `max_syllables` is split,
+ * and so is a long run of punctuations or blank lines.
+ *
+ * The context is reset.
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] reader        Callback function to read text.
+ * @param[in] reader_data   User-provided data to be passed to `reader`.
+ * @param[in] cache         Pointer to a unit cache (optional, can be NULL).
+ * @param[in] rx_samples    Callback function to receive PCM samples.
+ *                          When a non-0 value is returned by `rx_samples`, synthesis is aborted.
+ * @param[in] user_data     User-provided data to be passed to `rx_samples`.
+ * @param[in] scratch1      Scratch memory 1 for internal use during synthesis.
+ * @param[in] scratch2      Scratch memory 2 for internal use during synthesis.
+ * @param[in] clock         Clock for statistics (optional, can be NULL).
+ * @param[out] stats        Statistics (optional, can be NULL).
+ *
+ * @return Returns 0 on success, -1 if the text can't be analyzed, or the
+ *         non-0 value returned by `rx_samples`.
+ */
+int tts_synthesize_window(struct tts_context *ctx, f_tts_read_text reader, void *reader_data,
+    struct tts_unit_cache *cache, f_tts_receive_pcm_samples rx_samples, void *user_data,
+    void *scratch1, void *scratch2, f_tts_clock clock, struct tts_stats *stats);
+
+/**
+ * @brief Finds the longest word of the lexicon at the beginning of a string.
+ *
+ * Words are looked up in a trie built by `tools/voice_layout -t`. A phrase
+ * that is too long is cut between such words by `tts_push_utf8_phrase` and
+ * `tts_synthesize_window`, if the voice definition has a trie.
+ *
+ * @param[in] voice         Pointer to the voice definition.
+ * @param[in] utf8_str      UTF-8 encoded string.
+ * @param[in] max_bytes     Maximum length of the word in bytes.
+ *
+ * @return Length of the word in bytes, 0 if no word is found, or -1 if the
+ *         voice definition has no trie.
+ */
+int tts_lexicon_match(const struct voice_definition *voice, const char *utf8_str, int max_bytes);
+
+struct tts_prompt_cache;
+
+/**
+ * @brief Statistics of a prompt cache.
+ */
+struct tts_prompt_cache_stats
+{
+    uint32_t hits;              // prompts played from the cache
+    uint32_t misses;            // prompts synthesized
+    uint32_t stored;            // prompts added to the cache
+    uint32_t evictions;         // prompts evicted (the region is erased as a whole)
+    uint32_t failures;          // prompts that could not be stored (e.g. flash is full)
+    int prompts;                // prompts currently in the cache
+    int used_bytes;             // bytes of the region in use
+};
+
+/**
+ * @brief A function pointer type to program flash of a prompt cache.
+ *
+ * Bytes to be programmed are erased (0xFF) before. Once this function
+ * returns, new data must be readable through the region (e.g. invalidate
+ * the flash cache).
+ *
+ * @param[in] offset        Offset within the region.
+ * @param[in] data          Data to be programmed.
+ * @param[in] size          Number of bytes (1 ~ 32, or the length of a text).
+ * @param[in] user_data     User data given to `tts_prompt_cache_init`.
+ *
+ * @return 0 if succeeded, otherwise non-zero.
+ */
+typedef int (*f_tts_flash_program)(uint32_t offset, const void *data, int size, void *user_data);
+
+/**
+ * @brief A function pointer type to erase the whole region of a prompt cache.
+ *
+ * @param[in] user_data     User data given to `tts_prompt_cache_init`.
+ *
+ * @return 0 if succeeded, otherwise non-zero.
+ */
+typedef int (*f_tts_flash_erase)(void *user_data);
+
+/**
+ * @brief Retrieves the size of a prompt cache.
+ *
+ * A prompt cache keeps whole prompts (such as "欢迎使用") in flash, as ADPCM
+ * (4 bits per sample, 8KB per second). A cached prompt is played without
+ * text analysis or decoding of units, at a small fraction of the cost.
+ *
+ * @return The size in bytes.
+ */
+int tts_get_prompt_cache_size(void);
+
+/**
+ * @brief Initializes a prompt cache.
+ *
+ * The region is read through `region` (e.g. XIP). It can be built on Linux
+ * with `tools/prompt_cache` and programmed with the firmware, or filled on
+ * device when prompts are synthesized for the first time.
+ *
+ * Without `program` and `erase` the cache is read-only. Otherwise, a region
+ * that doesn't hold a prompt cache is erased and formatted.
+ *
+ * About 1% of the region is used for a hash index. Flash can't be rewritten
+ * in place, so when the region is full (or the voice changes), it is erased
+ * and all prompts are evicted.
+ *
+ * @param[in] region        Pointer to the region (aligned to 4 bytes).
+ * @param[in] size          Size of the region in bytes (a multiple of the erase unit).
+ * @param[in] program       Function to program flash (optional, can be NULL).
+ * @param[in] erase         Function to erase the region (optional, can be NULL).
+ * @param[in] user_data     User data passed to `program` and `erase`.
+ * @param[in] buf           Buffer of `tts_get_prompt_cache_size()` bytes.
+ *
+ * @return A pointer to the initialized cache, or NULL if the region is not a
+ *         prompt cache and can't be formatted.
+ */
+struct tts_prompt_cache *tts_prompt_cache_init(const void *region, int size,
+    f_tts_flash_program program, f_tts_flash_erase erase, void *user_data, void *buf);
+
+/**
+ * @brief Erases all prompts of a prompt cache.
+ *
+ * Statistics are kept.
+ *
+ * @param[in] cache         Pointer to the prompt cache.
+ *
+ * @return 0 if succeeded, otherwise -1 (e.g. the cache is read-only).
+ */
+int tts_prompt_cache_clear(struct tts_prompt_cache *cache);
+
+/**
+ * @brief Gets the statistics of a prompt cache.
+ *
+ * @param[in] cache         Pointer to the prompt cache.
+ * @param[out] stats        Statistics.
+ */
+void tts_prompt_cache_get_stats(const struct tts_prompt_cache *cache, struct tts_prompt_cache_stats *stats);
+
+/**
+ * @brief Resets the counters of a prompt cache.
+ *
+ * @param[in] cache         Pointer to the prompt cache.
+ */
+void tts_prompt_cache_reset_stats(struct tts_prompt_cache *cache);
+
+/**
+ * @brief (Method #1) Synthesizes a prompt through a prompt cache.
+ *
+ * If `utf8_str` is found in `cache` (the same text, voice definition and
+ * `tts_tune`), it is played from the cache, and the context is not changed.
+ *
+ * Otherwise, the context is reset, `utf8_str` is pushed (`tts_push_utf8_str`)
+ * and synthesized as `tts_synthesize_cached`. If the cache is writable, PCM
+ * samples are encoded and stored while they are delivered. A prompt that is
+ * aborted is not stored, and neither is a prompt that does not fit in the
+ * whole region (the region is not erased again for it).
+ *
+ * Cached prompts are slightly different from synthesized ones because of
+ * ADPCM.
+ *
+ * @param[in] ctx           Pointer to the TTS context structure.
+ * @param[in] cache         Pointer to the prompt cache.
+ * @param[in] utf8_str      Pointer to the null-terminated UTF-8 encoded text.
+ * @param[in] unit_cache    Pointer to a unit cache (optional, can be NULL).
+ * @param[in] rx_samples    Callback function to receive PCM samples.
+ *                          When a non-0 value is returned by `rx_samples`, synthesis is aborted.
+ * @param[in] user_data     User-provided data to be passed to the callback function.
+ * @param[in] scratch1      Scratch memory 1 for internal use during synthesis.
+ * @param[in] scratch2      Scratch memory 2 for internal use during synthesis.
+ *
+ * @return Returns 0 on success, -1 if the text can't be pushed, or the
+ *         non-0 value returned by `rx_samples`.
+ */
+int tts_synthesize_prompt(struct tts_context *ctx, struct tts_prompt_cache *cache, const char *utf8_str,
+    struct tts_unit_cache *unit_cache, f_tts_receive_pcm_samples rx_samples, void *user_data,
+    void *scratch1, void *scratch2);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,25 @@
+#include "amr_wb.h"
+#include "amr_wb_priv.h"
+
+// header of a SPEECH_LOST frame, which has no payload
+static const uint8_t toc_speech_lost = (AMR_WB_FT_SPEECH_LOST << AMR_WB_TOC_FT_SHIFT) | AMR_WB_TOC_Q;
+
+int amr_wb_decoder_decode_frame2(struct amr_wb_decoder *ctx, const uint8_t *payload, int flags,
+                                 int16_t *synth_pcm, void *scratch)
+{
+    // the quality bit is taken from the probed header when the payload is unpacked:
+    // speech frames become RX_SPEECH_BAD, SID frames become RX_SID_BAD.
+    if (flags & AMR_WB_DECODER_FLAG_BAD_FRAME)
+        ((struct amr_wb_decoder_head *)ctx)->toc &= ~AMR_WB_TOC_Q;
+
+    return amr_wb_decoder_decode_frame(ctx, payload, synth_pcm, scratch);
+}
+
+int amr_wb_decoder_conceal_frame(struct amr_wb_decoder *ctx, int16_t *synth_pcm, void *scratch)
+{
+    if (amr_wb_decoder_probe(ctx, &toc_speech_lost) < 0)
+        return -1;
+
+    // payload is not accessed for SPEECH_LOST
+    return amr_wb_decoder_decode_frame(ctx, &toc_speech_lost, synth_pcm, scratch);
+}
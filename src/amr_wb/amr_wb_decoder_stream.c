@@ -0,0 +1,57 @@
+#include "amr_wb.h"
+#include "amr_wb_priv.h"
+#include <string.h>
+
+/* ToC byte of a NO_DATA frame (Q = 1) */
+static const uint8_t toc_no_data = (AMR_WB_FT_NO_DATA << AMR_WB_TOC_FT_SHIFT) | AMR_WB_TOC_Q;
+
+int amr_wb_decoder_decode_stream(struct amr_wb_decoder *ctx, const uint8_t *stream, int len,
+                                 int16_t *pcm_out, int max_frames, void *scratch, int *consumed)
+{
+    const int header_size = amr_wb_get_frame_header_size(AMR_WB_BIT_STREAM_FORMAT_MIME_IETF);
+    const uint8_t *p = stream;
+    const uint8_t *end = stream + len;
+    int frames = 0;
+
+    if ((len >= AMR_WB_MIME_MAGIC_LEN) && (memcmp(p, AMR_WB_MIME_MAGIC, AMR_WB_MIME_MAGIC_LEN) == 0))
+        p += AMR_WB_MIME_MAGIC_LEN;
+
+    while ((frames < max_frames) && (end - p >= header_size))
+    {
+        int ft = AMR_WB_TOC_FT(p[0]);
+        int payload_len;
+
+        // frame types 10..13 are reserved: treat them as NO_DATA, as the payload
+        // length is unknown to the decoder, and the frame is only 1 byte long.
+        if ((ft > AMR_WB_FT_SID) && (ft < AMR_WB_FT_SPEECH_LOST))
+        {
+            if (amr_wb_decoder_probe(ctx, &toc_no_data) < 0)
+            {
+                if (frames == 0) frames = -1;
+                break;
+            }
+            payload_len = 0;
+        }
+        else
+        {
+            payload_len = amr_wb_decoder_probe(ctx, p);
+            if (payload_len < 0)
+            {
+                if (frames == 0) frames = -1;
+                break;
+            }
+            // a truncated frame is left for the next call. Probing it again
+            // then is harmless: it only records the header.
+            if (end - p < header_size + payload_len)
+                break;
+        }
+
+        amr_wb_decoder_decode_frame(ctx, p + header_size, pcm_out, scratch);
+        pcm_out += AMR_WB_PCM_FRAME_16k;
+        p += header_size + payload_len;
+        frames++;
+    }
+
+    if (consumed) *consumed = (int)(p - stream);
+    return frames;
+}
@@ -0,0 +1,64 @@
+#include "amr_wb.h"
+#include "amr_wb_priv.h"
+
+#define LEVEL_FLOOR     (-96)
+
+static int16_t enc_field(const struct amr_wb_encoder *ctx, int offset)
+{
+    return *(const int16_t *)((const uint8_t *)ctx + offset);
+}
+
+// log2(x) in Q8 for x > 0, with linear interpolation of the mantissa
+static int log2_q8(uint32_t x)
+{
+    int e = 31 - __builtin_clz(x);
+    uint32_t m = e >= 8 ? x >> (e - 8) : x << (8 - e);  // [256, 512)
+    return (e << 8) + (int)(m - 256);
+}
+
+// 10 * log10(mean square / 32768^2)
+static int16_t frame_level(const int16_t *pcm, int n)
+{
+    uint64_t sum = 0;
+    uint32_t ms;
+    int i;
+    int level;
+
+    for (i = 0; i < n; i++)
+        sum += (uint32_t)((int32_t)pcm[i] * pcm[i]);
+    ms = (uint32_t)(sum / n);
+    if (ms == 0)
+        return LEVEL_FLOOR;
+
+    // 10*log10(2) = 3.0103 ~= 771 / 256
+    level = ((log2_q8(ms) - (30 << 8)) * 771 + (1 << 15)) >> 16;
+    return level < LEVEL_FLOOR ? LEVEL_FLOOR : (int16_t)level;
+}
+
+int amr_wb_encoder_encode_frame3(struct amr_wb_encoder *ctx, int mode,
+                                 const int16_t *pcm_samples, uint8_t *output, void *scratch,
+                                 struct amr_wb_encoder_frame_info *info)
+{
+    int r;
+
+    // measure before encoding: `pcm_samples` may be the same buffer as `scratch`
+    info->level = frame_level(pcm_samples, AMR_WB_PCM_FRAME_16k);
+
+    r = amr_wb_encoder_encode_frame2(ctx, mode, pcm_samples, output, scratch);
+
+    info->vad = enc_field(ctx, AMR_WB_ENC_VAD_HIST) == 0;
+    switch (enc_field(ctx, AMR_WB_ENC_TX_TYPE))
+    {
+    case AMR_WB_TX_SID_FIRST:
+    case AMR_WB_TX_SID_UPDATE:
+        info->frame_type = AMR_WB_FRAME_TYPE_SID;
+        break;
+    case AMR_WB_TX_NO_DATA:
+        info->frame_type = AMR_WB_FRAME_TYPE_NO_DATA;
+        break;
+    default:
+        info->frame_type = AMR_WB_FRAME_TYPE_SPEECH;
+        break;
+    }
+    return r;
+}
@@ -0,0 +1,50 @@
+#ifndef _amr_wb_priv_h
+#define _amr_wb_priv_h
+
+#include <stdint.h>
+
+// Leading fields of `struct amr_wb_decoder` (layout of the prebuilt decoder).
+struct amr_wb_decoder_head
+{
+    uint8_t toc;                // header of the frame being decoded (as probed)
+    uint8_t reserved0[3];
+    int16_t mode;
+    int16_t frame_type;         // RX_xxx
+    int16_t output_len;
+    int16_t packed_size;
+    int16_t reset_flag;
+    int16_t reset_flag_old;
+    int16_t mode_old;
+};
+
+// Offsets of fields in `struct amr_wb_decoder` (layout of the prebuilt decoder).
+#define AMR_WB_DEC_DECODER_STATE    32
+// int16_t: integer pitch lag (at 12.8kHz) of the last subframe of the last good frame
+#define AMR_WB_DEC_OLD_T0           (AMR_WB_DEC_DECODER_STATE + 1054)
+
+// Offsets of fields in `struct amr_wb_encoder` (layout of the prebuilt encoder).
+#define AMR_WB_ENC_CODER_STATE      168
+// int16_t: number of consecutive frames with VAD = 0 (0 if VAD = 1 in last frame)
+#define AMR_WB_ENC_VAD_HIST         (AMR_WB_ENC_CODER_STATE + 2116)
+// int16_t: TX_xxx of last frame
+#define AMR_WB_ENC_TX_TYPE          (AMR_WB_ENC_CODER_STATE + 2124)
+
+#define AMR_WB_TX_SPEECH            0
+#define AMR_WB_TX_SID_FIRST         1
+#define AMR_WB_TX_SID_UPDATE        2
+#define AMR_WB_TX_NO_DATA           3
+
+// Bits of MIME/IETF frame header (ToC)
+#define AMR_WB_TOC_FT_SHIFT         3
+#define AMR_WB_TOC_FT_MASK          0xf
+#define AMR_WB_TOC_Q                0x04
+// F bit: only in the ToC of an RTP payload (RFC 4867), another entry follows
+#define AMR_WB_TOC_F                0x80
+
+#define AMR_WB_TOC_FT(toc)          (((toc) >> AMR_WB_TOC_FT_SHIFT) & AMR_WB_TOC_FT_MASK)
+
+#define AMR_WB_FT_SID               9
+#define AMR_WB_FT_SPEECH_LOST       14
+#define AMR_WB_FT_NO_DATA           15
+
+#endif
@@ -0,0 +1,162 @@
+#include "amr_wb.h"
+#include <string.h>
+
+// defaults of thresholds
+#define DEF_LOSS_HIGH       30      // 3%
+#define DEF_LOSS_LOW        10      // 1%
+#define DEF_JITTER_HIGH     60
+#define DEF_JITTER_LOW      30
+#define DEF_QUEUE_HIGH      6
+#define DEF_QUEUE_LOW       2
+#define DEF_UP_HOLD         150     // 3s
+#define DEF_DOWN_HOLD       10      // 200ms
+
+// smoothing factor of loss & jitter: 1 / (1 << SMOOTH_SHIFT)
+#define SMOOTH_SHIFT        2
+
+enum condition
+{
+    COND_GOOD,
+    COND_FAIR,
+    COND_BAD,
+    COND_SEVERE,
+};
+
+static int clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static void state_init(struct amr_wb_rate_state *s, int mode)
+{
+    s->mode = (int8_t)mode;
+    s->good_cnt = 0;
+    s->since_down = 0xffff;
+}
+
+// returns the mode after one frame under condition `cond`
+static int state_step(struct amr_wb_rate_state *s, enum condition cond, int hold_up, int hold_down,
+                      int min_mode, int max_mode)
+{
+    int mode = s->mode;
+
+    if (s->since_down < 0xffff) s->since_down++;
+
+    switch (cond)
+    {
+    case COND_SEVERE:
+    case COND_BAD:
+        s->good_cnt = 0;
+        if (s->since_down >= hold_down)
+        {
+            mode -= cond == COND_SEVERE ? 2 : 1;
+            s->since_down = 0;
+        }
+        break;
+    case COND_FAIR:
+        s->good_cnt = 0;
+        break;
+    case COND_GOOD:
+        if (++s->good_cnt >= hold_up)
+        {
+            mode++;
+            s->good_cnt = 0;
+        }
+        break;
+    }
+
+    mode = clamp(mode, min_mode, max_mode);
+    s->mode = (int8_t)mode;
+    return mode;
+}
+
+static enum condition classify(int v, int low, int high)
+{
+    if (v > 2 * high) return COND_SEVERE;
+    if (v > high) return COND_BAD;
+    if (v >= low) return COND_FAIR;
+    return COND_GOOD;
+}
+
+static enum condition worse(enum condition a, enum condition b)
+{
+    return a > b ? a : b;
+}
+
+void amr_wb_rate_ctrl_init(struct amr_wb_rate_ctrl *ctrl, int initial_mode, int min_mode, int max_mode)
+{
+    memset(ctrl, 0, sizeof(*ctrl));
+    min_mode = clamp(min_mode, AMR_WB_MODE_6600bps, AMR_WB_MODE_23850bps);
+    max_mode = clamp(max_mode, min_mode, AMR_WB_MODE_23850bps);
+    initial_mode = clamp(initial_mode, min_mode, max_mode);
+
+    ctrl->min_mode    = (int8_t)min_mode;
+    ctrl->max_mode    = (int8_t)max_mode;
+    ctrl->loss_high   = DEF_LOSS_HIGH;
+    ctrl->loss_low    = DEF_LOSS_LOW;
+    ctrl->jitter_high = DEF_JITTER_HIGH;
+    ctrl->jitter_low  = DEF_JITTER_LOW;
+    ctrl->queue_high  = DEF_QUEUE_HIGH;
+    ctrl->queue_low   = DEF_QUEUE_LOW;
+    ctrl->up_hold     = DEF_UP_HOLD;
+    ctrl->down_hold   = DEF_DOWN_HOLD;
+
+    ctrl->peer_cmr = AMR_WB_CMR_NO_REQUEST;
+    state_init(&ctrl->tx, initial_mode);
+    state_init(&ctrl->link, max_mode);
+}
+
+void amr_wb_rate_ctrl_on_peer_cmr(struct amr_wb_rate_ctrl *ctrl, int cmr)
+{
+    if ((cmr >= AMR_WB_MODE_6600bps) && (cmr <= AMR_WB_MODE_23850bps))
+        ctrl->peer_cmr = (int8_t)cmr;
+    else if (cmr == AMR_WB_CMR_NO_REQUEST)
+        ctrl->peer_cmr = AMR_WB_CMR_NO_REQUEST;
+    // other values are reserved and ignored
+}
+
+void amr_wb_rate_ctrl_report_rx(struct amr_wb_rate_ctrl *ctrl, int received, int lost, int jitter_ms)
+{
+    int total = received + lost;
+    int v;
+
+    if (total > 0)
+    {
+        int loss = lost * 1000 / total;
+        v = ctrl->loss;
+        v += (loss - v) >> SMOOTH_SHIFT;
+        ctrl->loss = (uint16_t)clamp(v, 0, 1000);
+    }
+
+    if (jitter_ms >= 0)
+    {
+        v = ctrl->jitter;
+        v += ((clamp(jitter_ms, 0, 4000) << 4) - v) >> SMOOTH_SHIFT;
+        ctrl->jitter = (uint16_t)v;
+    }
+}
+
+void amr_wb_rate_ctrl_report_tx_queue(struct amr_wb_rate_ctrl *ctrl, int frames)
+{
+    ctrl->queue = (uint16_t)clamp(frames, 0, 0xffff);
+}
+
+int amr_wb_rate_ctrl_next_mode(struct amr_wb_rate_ctrl *ctrl)
+{
+    enum condition link = worse(classify(ctrl->loss, ctrl->loss_low, ctrl->loss_high),
+                                classify(ctrl->jitter >> 4, ctrl->jitter_low, ctrl->jitter_high));
+    enum condition tx = worse(link, classify(ctrl->queue, ctrl->queue_low, ctrl->queue_high));
+    int cap = ctrl->max_mode;
+
+    // peer's request takes effect immediately
+    if (ctrl->peer_cmr != AMR_WB_CMR_NO_REQUEST)
+        cap = clamp(ctrl->peer_cmr, ctrl->min_mode, ctrl->max_mode);
+
+    state_step(&ctrl->link, link, ctrl->up_hold, ctrl->down_hold, ctrl->min_mode, ctrl->max_mode);
+    return state_step(&ctrl->tx, tx, ctrl->up_hold, ctrl->down_hold, ctrl->min_mode, cap);
+}
+
+int amr_wb_rate_ctrl_get_cmr(const struct amr_wb_rate_ctrl *ctrl)
+{
+    return ctrl->link.mode >= ctrl->max_mode ? AMR_WB_CMR_NO_REQUEST : ctrl->link.mode;
+}
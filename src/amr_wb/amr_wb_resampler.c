@@ -0,0 +1,265 @@
+#include "amr_wb.h"
+#include <string.h>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#define USE_SMLAD
+#endif
+
+#define IN_RATE         16000
+#define IN_FRAME        AMR_WB_PCM_FRAME_16k
+
+#define UP_PHASES       48
+#define UP_TAPS         24
+#define DOWN_TAPS       32
+
+// Coefficients are in Q15, and the sum of their absolute values is less than
+// 65536 for each phase, so a 32-bit accumulator never overflows.
+
+// 16kHz -> 44.1/48kHz: 48 phases (+1 for interpolation) x 24 taps, Kaiser-windowed sinc, fc = 7kHz
+static const int16_t fir_up[(UP_PHASES + 1) * UP_TAPS] =
+{
+       -22,     44,    -52,      0,    171,   -519,   1072,  -1802,   2616,  -3369,   3904,  28682,
+      3904,  -3369,   2616,  -1802,   1072,   -519,    171,      0,    -52,     44,    -22,      0,
+       -21,     41,    -44,    -14,    192,   -542,   1086,  -1783,   2525,  -3132,   3286,  28659,
+      4535,  -3600,   2700,  -1816,   1055,   -493,    149,     15,    -59,     47,    -23,      5,
+       -19,     37,    -36,    -29,    212,   -564,   1095,  -1758,   2427,  -2890,   2683,  28614,
+      5179,  -3826,   2777,  -1823,   1033,   -465,    125,     30,    -67,     51,    -24,      6,
+       -18,     34,    -28,    -42,    231,   -582,   1101,  -1727,   2323,  -2645,   2097,  28530,
+      5836,  -4043,   2846,  -1825,   1008,   -435,    101,     45,    -75,     54,    -24,      6,
+       -17,     31,    -21,    -55,    249,   -599,   1103,  -1692,   2213,  -2397,   1528,  28421,
+      6504,  -4253,   2906,  -1821,    979,   -403,     76,     61,    -83,     57,    -25,      6,
+       -16,     27,    -13,    -68,    265,   -613,   1101,  -1651,   2098,  -2146,    976,  28279,
+      7182,  -4454,   2958,  -1810,    946,   -369,     50,     77,    -91,     60,    -26,      6,
+       -15,     24,     -6,    -80,    281,   -625,   1096,  -1606,   1979,  -1895,    442,  28105,
+      7869,  -4645,   3002,  -1793,    909,   -333,     23,     93,    -99,     63,    -27,      6,
+       -14,     21,      1,    -92,    295,   -635,   1087,  -1556,   1855,  -1643,    -72,  27900,
+      8564,  -4825,   3035,  -1769,    868,   -295,     -4,    109,   -106,     65,    -27,      6,
+       -13,     17,      8,   -102,    307,   -642,   1075,  -1502,   1727,  -1391,   -567,  27665,
+      9265,  -4994,   3060,  -1739,    824,   -255,    -32,    125,   -114,     68,    -28,      6,
+       -11,     14,     14,   -113,    319,   -647,   1059,  -1444,   1596,  -1141,  -1042,  27402,
+      9972,  -5150,   3074,  -1703,    776,   -214,    -60,    141,   -121,     70,    -29,      6,
+       -10,     11,     21,   -122,    329,   -649,   1040,  -1382,   1462,   -893,  -1495,  27104,
+     10683,  -5292,   3078,  -1660,    724,   -171,    -89,    157,   -128,     73,    -29,      6,
+        -9,      8,     27,   -131,    337,   -650,   1018,  -1317,   1326,   -647,  -1928,  26785,
+     11396,  -5421,   3072,  -1611,    669,   -127,   -118,    172,   -135,     75,    -29,      6,
+        -8,      5,     33,   -140,    345,   -648,    993,  -1248,   1188,   -405,  -2339,  26431,
+     12112,  -5535,   3056,  -1556,    611,    -81,   -147,    188,   -141,     77,    -29,      6,
+        -7,      2,     38,   -147,    351,   -644,    965,  -1177,   1049,   -167,  -2727,  26054,
+     12827,  -5633,   3028,  -1494,    550,    -34,   -177,    203,   -147,     78,    -29,      6,
+        -6,     -1,     44,   -154,    356,   -638,    934,  -1103,    909,     66,  -3093,  25648,
+     13542,  -5715,   2990,  -1426,    485,     14,   -206,    218,   -153,     80,    -29,      6,
+        -5,     -3,     48,   -160,    359,   -630,    901,  -1026,    768,    294,  -3437,  25219,
+     14254,  -5780,   2941,  -1351,    418,     62,   -236,    232,   -158,     81,    -29,      6,
+        -4,     -6,     53,   -166,    361,   -620,    865,   -948,    628,    516,  -3758,  24764,
+     14963,  -5827,   2881,  -1271,    348,    112,   -265,    246,   -163,     82,    -29,      6,
+        -3,     -9,     57,   -171,    362,   -608,    827,   -867,    488,    731,  -4056,  24285,
+     15667,  -5856,   2811,  -1185,    276,    162,   -294,    260,   -168,     82,    -29,      6,
+        -2,    -11,     61,   -175,    361,   -594,    787,   -786,    349,    939,  -4330,  23785,
+     16364,  -5866,   2729,  -1094,    201,    212,   -322,    273,   -172,     82,    -28,      5,
+        -1,    -13,     65,   -178,    360,   -579,    746,   -703,    212,   1139,  -4582,  23258,
+     17054,  -5856,   2636,   -997,    124,    263,   -350,    285,   -175,     82,    -27,      5,
+         0,    -15,     68,   -181,    357,   -562,    702,   -619,     76,   1332,  -4810,  22713,
+     17735,  -5826,   2532,   -894,     46,    314,   -378,    297,   -178,     82,    -27,      4,
+         0,    -17,     71,   -183,    353,   -543,    657,   -535,    -57,   1515,  -5016,  22150,
+     18406,  -5776,   2418,   -787,    -35,    365,   -404,    307,   -181,     82,    -26,      4,
+         1,    -19,     74,   -184,    348,   -523,    611,   -451,   -187,   1690,  -5198,  21564,
+     19066,  -5704,   2292,   -675,   -116,    415,   -430,    317,   -183,     81,    -25,      4,
+         2,    -20,     76,   -185,    342,   -501,    563,   -366,   -315,   1855,  -5358,  20963,
+     19713,  -5611,   2157,   -559,   -199,    465,   -455,    326,   -184,     79,    -23,      3,
+         2,    -22,     78,   -185,    334,   -479,    514,   -282,   -439,   2011,  -5495,  20346,
+     20348,  -5495,   2011,   -439,   -282,    514,   -479,    334,   -185,     78,    -22,      2,
+         3,    -23,     79,   -184,    326,   -455,    465,   -199,   -559,   2157,  -5611,  19713,
+     20963,  -5358,   1855,   -315,   -366,    563,   -501,    342,   -185,     76,    -20,      2,
+         4,    -25,     81,   -183,    317,   -430,    415,   -116,   -675,   2292,  -5704,  19066,
+     21564,  -5198,   1690,   -187,   -451,    611,   -523,    348,   -184,     74,    -19,      1,
+         4,    -26,     82,   -181,    307,   -404,    365,    -35,   -787,   2418,  -5776,  18406,
+     22150,  -5016,   1515,    -57,   -535,    657,   -543,    353,   -183,     71,    -17,      0,
+         4,    -27,     82,   -178,    297,   -378,    314,     46,   -894,   2532,  -5826,  17735,
+     22713,  -4810,   1332,     76,   -619,    702,   -562,    357,   -181,     68,    -15,      0,
+         5,    -27,     82,   -175,    285,   -350,    263,    124,   -997,   2636,  -5856,  17054,
+     23258,  -4582,   1139,    212,   -703,    746,   -579,    360,   -178,     65,    -13,     -1,
+         5,    -28,     82,   -172,    273,   -322,    212,    201,  -1094,   2729,  -5866,  16364,
+     23785,  -4330,    939,    349,   -786,    787,   -594,    361,   -175,     61,    -11,     -2,
+         6,    -29,     82,   -168,    260,   -294,    162,    276,  -1185,   2811,  -5856,  15667,
+     24285,  -4056,    731,    488,   -867,    827,   -608,    362,   -171,     57,     -9,     -3,
+         6,    -29,     82,   -163,    246,   -265,    112,    348,  -1271,   2881,  -5827,  14963,
+     24764,  -3758,    516,    628,   -948,    865,   -620,    361,   -166,     53,     -6,     -4,
+         6,    -29,     81,   -158,    232,   -236,     62,    418,  -1351,   2941,  -5780,  14254,
+     25219,  -3437,    294,    768,  -1026,    901,   -630,    359,   -160,     48,     -3,     -5,
+         6,    -29,     80,   -153,    218,   -206,     14,    485,  -1426,   2990,  -5715,  13542,
+     25648,  -3093,     66,    909,  -1103,    934,   -638,    356,   -154,     44,     -1,     -6,
+         6,    -29,     78,   -147,    203,   -177,    -34,    550,  -1494,   3028,  -5633,  12827,
+     26054,  -2727,   -167,   1049,  -1177,    965,   -644,    351,   -147,     38,      2,     -7,
+         6,    -29,     77,   -141,    188,   -147,    -81,    611,  -1556,   3056,  -5535,  12112,
+     26431,  -2339,   -405,   1188,  -1248,    993,   -648,    345,   -140,     33,      5,     -8,
+         6,    -29,     75,   -135,    172,   -118,   -127,    669,  -1611,   3072,  -5421,  11396,
+     26785,  -1928,   -647,   1326,  -1317,   1018,   -650,    337,   -131,     27,      8,     -9,
+         6,    -29,     73,   -128,    157,    -89,   -171,    724,  -1660,   3078,  -5292,  10683,
+     27104,  -1495,   -893,   1462,  -1382,   1040,   -649,    329,   -122,     21,     11,    -10,
+         6,    -29,     70,   -121,    141,    -60,   -214,    776,  -1703,   3074,  -5150,   9972,
+     27402,  -1042,  -1141,   1596,  -1444,   1059,   -647,    319,   -113,     14,     14,    -11,
+         6,    -28,     68,   -114,    125,    -32,   -255,    824,  -1739,   3060,  -4994,   9265,
+     27665,   -567,  -1391,   1727,  -1502,   1075,   -642,    307,   -102,      8,     17,    -13,
+         6,    -27,     65,   -106,    109,     -4,   -295,    868,  -1769,   3035,  -4825,   8564,
+     27900,    -72,  -1643,   1855,  -1556,   1087,   -635,    295,    -92,      1,     21,    -14,
+         6,    -27,     63,    -99,     93,     23,   -333,    909,  -1793,   3002,  -4645,   7869,
+     28105,    442,  -1895,   1979,  -1606,   1096,   -625,    281,    -80,     -6,     24,    -15,
+         6,    -26,     60,    -91,     77,     50,   -369,    946,  -1810,   2958,  -4454,   7182,
+     28279,    976,  -2146,   2098,  -1651,   1101,   -613,    265,    -68,    -13,     27,    -16,
+         6,    -25,     57,    -83,     61,     76,   -403,    979,  -1821,   2906,  -4253,   6504,
+     28421,   1528,  -2397,   2213,  -1692,   1103,   -599,    249,    -55,    -21,     31,    -17,
+         6,    -24,     54,    -75,     45,    101,   -435,   1008,  -1825,   2846,  -4043,   5836,
+     28530,   2097,  -2645,   2323,  -1727,   1101,   -582,    231,    -42,    -28,     34,    -18,
+         6,    -24,     51,    -67,     30,    125,   -465,   1033,  -1823,   2777,  -3826,   5179,
+     28614,   2683,  -2890,   2427,  -1758,   1095,   -564,    212,    -29,    -36,     37,    -19,
+         5,    -23,     47,    -59,     15,    149,   -493,   1055,  -1816,   2700,  -3600,   4535,
+     28659,   3286,  -3132,   2525,  -1783,   1086,   -542,    192,    -14,    -44,     41,    -21,
+         0,    -22,     44,    -52,      0,    171,   -519,   1072,  -1802,   2616,  -3369,   3904,
+     28682,   3904,  -3369,   2616,  -1802,   1072,   -519,    171,      0,    -52,     44,    -22,
+};
+
+// 16kHz -> 8kHz: 32 taps, Kaiser-windowed sinc, fc = 3.3kHz
+static const int16_t fir_down[DOWN_TAPS] =
+{
+        10,    -25,    -65,     19,    188,    109,   -326,   -476,    283,   1123,    302,  -1923,
+     -2124,   2601,   9926,  13524,   9926,   2601,  -2124,  -1923,    302,   1123,    283,   -476,
+      -326,    109,    188,     19,    -65,    -25,     10,      0,
+};
+
+static int taps_of(int out_rate)
+{
+    return out_rate < IN_RATE ? DOWN_TAPS : UP_TAPS;
+}
+
+static int16_t saturate(int32_t v)
+{
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : (int16_t)v);
+}
+
+static int32_t dot(const int16_t *x, const int16_t *c, int n)
+{
+    int32_t acc = 0;
+#ifdef USE_SMLAD
+    // `x` may be unaligned, which LDR handles
+    for (; n > 0; n -= 2, x += 2, c += 2)
+    {
+        int16x2_t a, b;
+        memcpy(&a, x, sizeof(a));
+        memcpy(&b, c, sizeof(b));
+        acc = __smlad(a, b, acc);
+    }
+#else
+    for (; n > 0; n--)
+        acc += (int32_t)*x++ * *c++;
+#endif
+    return acc;
+}
+
+int amr_wb_resampler_init(struct amr_wb_resampler *rs, int out_rate)
+{
+    if (amr_wb_resampler_get_buf_size(out_rate) < 0)
+        return -1;
+
+    memset(rs, 0, sizeof(*rs));
+    rs->out_rate = out_rate;
+    // delay output by half of the filter, so that the filter never looks
+    // beyond the current frame.
+    rs->pos = (uint32_t)(taps_of(out_rate) / 2) * out_rate;
+    return 0;
+}
+
+int amr_wb_resampler_get_buf_size(int out_rate)
+{
+    switch (out_rate)
+    {
+    case IN_RATE:
+        return IN_FRAME;
+    case 8000:
+        return IN_FRAME + DOWN_TAPS;
+    case 44100:
+    case 48000:
+        return (IN_FRAME * out_rate + IN_RATE - 1) / IN_RATE + 1 + UP_TAPS;
+    default:
+        return -1;
+    }
+}
+
+int16_t *amr_wb_resampler_get_input(const struct amr_wb_resampler *rs, int16_t *buf)
+{
+    // Output is written from `buf[0]` forward, and each output sample only
+    // depends on input samples at or after its own position minus the filter
+    // length: put the input after room for the filter when down-sampling,
+    // and at the end of the buffer when up-sampling.
+    if (rs->out_rate == IN_RATE)
+        return buf;
+    else if (rs->out_rate < IN_RATE)
+        return buf + DOWN_TAPS;
+    else
+        return buf + amr_wb_resampler_get_buf_size(rs->out_rate) - IN_FRAME;
+}
+
+int amr_wb_resampler_process(struct amr_wb_resampler *rs, int16_t *buf)
+{
+    const int out_rate = rs->out_rate;
+    const int taps = taps_of(out_rate);
+    const int16_t *x = amr_wb_resampler_get_input(rs, buf);
+    const uint32_t end = (uint32_t)(taps / 2 + IN_FRAME) * out_rate;
+    // history followed by the head of this frame: for the first outputs
+    int16_t head[2 * DOWN_TAPS];
+    uint32_t pos = rs->pos;
+    int n = 0;
+
+    if (out_rate == IN_RATE)
+        return IN_FRAME;
+
+    memcpy(head, rs->history, taps * sizeof(head[0]));
+    memcpy(head + taps, x, taps * sizeof(head[0]));
+
+    while (pos < end)
+    {
+        // input is `history ++ x`, and `i` is the index into it
+        int i = pos / out_rate;
+        int start = i - taps / 2 + 1;
+        const int16_t *w = start < taps ? head + start : x + start - taps;
+        int32_t v;
+
+        if (out_rate < IN_RATE)
+        {
+            // integer decimation: always on input samples
+            v = (dot(w, fir_down, DOWN_TAPS) + (1 << 14)) >> 15;
+        }
+        else
+        {
+            uint32_t pq = (pos - i * out_rate) * UP_PHASES;
+            int p = pq / out_rate;
+            int r = pq - p * out_rate;
+
+            v = (dot(w, fir_up + p * UP_TAPS, UP_TAPS) + (1 << 14)) >> 15;
+            if (r)
+            {
+                // linear interpolation between two adjacent phases
+                int32_t v1 = (dot(w, fir_up + (p + 1) * UP_TAPS, UP_TAPS) + (1 << 14)) >> 15;
+                int32_t mu = ((uint32_t)r << 15) / out_rate;
+                v += ((v1 - v) * mu + (1 << 14)) >> 15;
+            }
+        }
+
+        buf[n++] = saturate(v);
+        pos += IN_RATE;
+    }
+
+    rs->pos = pos - (uint32_t)IN_FRAME * out_rate;
+    memcpy(rs->history, x + IN_FRAME - taps, taps * sizeof(rs->history[0]));
+    return n;
+}
+
+int amr_wb_decoder_decode_frame_resampled(struct amr_wb_decoder *ctx, const uint8_t *payload,
+                                          struct amr_wb_resampler *rs, int16_t *buf, void *scratch)
+{
+    int16_t *x = amr_wb_resampler_get_input(rs, buf);
+    int r = amr_wb_decoder_decode_frame(ctx, payload, x, scratch);
+    if (r != IN_FRAME)
+        return r;
+    return amr_wb_resampler_process(rs, buf);
+}
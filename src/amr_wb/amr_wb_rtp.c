@@ -0,0 +1,277 @@
+#include "amr_wb.h"
+#include "amr_wb_priv.h"
+#include <string.h>
+
+// RFC 4867 payload format, single channel, no interleaving/CRC.
+
+#define MAX_FRAMES_PER_PACKET   12
+
+// FT and Q bits of a ToC entry
+#define TOC_FT_Q                ((AMR_WB_TOC_FT_MASK << AMR_WB_TOC_FT_SHIFT) | AMR_WB_TOC_Q)
+
+// ToC entry of a NO_DATA frame (Q = 1)
+#define TOC_NO_DATA             ((AMR_WB_FT_NO_DATA << AMR_WB_TOC_FT_SHIFT) | AMR_WB_TOC_Q)
+
+// number of speech bits of each frame type (RFC 4867, table 1 of 3GPP TS 26.201)
+static const uint16_t frame_bits[16] =
+{
+    132, 177, 253, 285, 317, 365, 397, 461, 477, 40, 0, 0, 0, 0, 0, 0
+};
+
+static int is_reserved(int ft)
+{
+    return (ft > AMR_WB_FT_SID) && (ft < AMR_WB_FT_SPEECH_LOST);
+}
+
+static void put_bits(uint8_t *buf, int pos, uint32_t v, int n)
+{
+    while (n > 0)
+    {
+        uint8_t mask = 0x80 >> (pos & 7);
+        n--;
+        if ((v >> n) & 1)
+            buf[pos >> 3] |= mask;
+        else
+            buf[pos >> 3] &= ~mask;
+        pos++;
+    }
+}
+
+static uint32_t get_bits(const uint8_t *buf, int pos, int n)
+{
+    uint32_t v = 0;
+    while (n > 0)
+    {
+        v = (v << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+        pos++;
+        n--;
+    }
+    return v;
+}
+
+static void copy_bits(uint8_t *dst, int dst_pos, const uint8_t *src, int src_pos, int n)
+{
+    // byte-aligned on both sides is the common case in octet-aligned mode
+    if (((dst_pos | src_pos) & 7) == 0)
+    {
+        memcpy(dst + (dst_pos >> 3), src + (src_pos >> 3), n >> 3);
+        dst_pos += n & ~7;
+        src_pos += n & ~7;
+        n &= 7;
+    }
+    while (n >= 8)
+    {
+        put_bits(dst, dst_pos, get_bits(src, src_pos, 8), 8);
+        dst_pos += 8;
+        src_pos += 8;
+        n -= 8;
+    }
+    if (n > 0)
+        put_bits(dst, dst_pos, get_bits(src, src_pos, n), n);
+}
+
+static int frame_bytes(int ft)
+{
+    return (frame_bits[ft] + 7) >> 3;
+}
+
+static int header_bits(int payload_format, int frames)
+{
+    return payload_format == AMR_WB_RTP_OCTET_ALIGNED ? 8 + 8 * frames : 4 + 6 * frames;
+}
+
+int amr_wb_rtp_get_max_packet_size(int payload_format, int frames_per_packet)
+{
+    if (payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+        return 1 + frames_per_packet * (1 + frame_bytes(AMR_WB_MODE_23850bps));
+    else
+        return (header_bits(payload_format, frames_per_packet)
+                + frames_per_packet * frame_bits[AMR_WB_MODE_23850bps] + 7) >> 3;
+}
+
+int amr_wb_rtp_packer_init(struct amr_wb_rtp_packer *packer, int payload_format, int frames_per_packet)
+{
+    if ((frames_per_packet < 1) || (frames_per_packet > MAX_FRAMES_PER_PACKET))
+        return -1;
+    if ((payload_format != AMR_WB_RTP_OCTET_ALIGNED) && (payload_format != AMR_WB_RTP_BANDWIDTH_EFFICIENT))
+        return -1;
+
+    memset(packer, 0, sizeof(*packer));
+    packer->payload_format = payload_format;
+    packer->frames_per_packet = frames_per_packet;
+    return 0;
+}
+
+int amr_wb_rtp_packer_begin(struct amr_wb_rtp_packer *packer, uint8_t *packet, int capacity, int cmr)
+{
+    int hdr = header_bits(packer->payload_format, packer->frames_per_packet);
+    if (capacity * 8 < hdr)
+        return -1;
+    if ((cmr < 0) || ((cmr > AMR_WB_MODE_23850bps) && (cmr != AMR_WB_CMR_NO_REQUEST)))
+        cmr = AMR_WB_CMR_NO_REQUEST;
+
+    packer->packet = packet;
+    packer->capacity = capacity;
+    packer->frame_num = 0;
+
+    if (packer->payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+    {
+        packet[0] = (uint8_t)(cmr << 4);
+        packer->pos = hdr >> 3;
+    }
+    else
+    {
+        put_bits(packet, 0, cmr, 4);
+        packer->pos = hdr;
+    }
+    return 0;
+}
+
+static int packer_put(struct amr_wb_rtp_packer *packer, uint8_t toc, const uint8_t *payload)
+{
+    int ft = AMR_WB_TOC_FT(toc);
+    int k = packer->frame_num;
+
+    if (k >= packer->frames_per_packet)
+        return -1;
+
+    // F bit is set for all but the last entry, which is fixed in `finish`
+    toc = (toc & TOC_FT_Q) | AMR_WB_TOC_F;
+
+    if (packer->payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+    {
+        int n = frame_bytes(ft);
+        if (packer->pos + n > packer->capacity)
+            return -1;
+        packer->packet[1 + k] = toc;
+        memcpy(packer->packet + packer->pos, payload, n);
+        packer->pos += n;
+    }
+    else
+    {
+        int n = frame_bits[ft];
+        if (packer->pos + n > packer->capacity * 8)
+            return -1;
+        put_bits(packer->packet, 4 + 6 * k, toc >> 2, 6);
+        copy_bits(packer->packet, packer->pos, payload, 0, n);
+        packer->pos += n;
+    }
+
+    packer->frame_num++;
+    return packer->frames_per_packet - packer->frame_num;
+}
+
+int amr_wb_rtp_packer_add_frame(struct amr_wb_rtp_packer *packer, const uint8_t *frame)
+{
+    const int header_size = amr_wb_get_frame_header_size(AMR_WB_BIT_STREAM_FORMAT_MIME_IETF);
+    uint8_t toc = frame[0];
+
+    if (is_reserved(AMR_WB_TOC_FT(toc)))
+        toc = TOC_NO_DATA;
+    return packer_put(packer, toc, frame + header_size);
+}
+
+int amr_wb_rtp_packer_finish(struct amr_wb_rtp_packer *packer)
+{
+    int last = packer->frames_per_packet - 1;
+
+    while (packer->frame_num < packer->frames_per_packet)
+        packer_put(packer, TOC_NO_DATA, NULL);
+
+    if (packer->payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+    {
+        packer->packet[1 + last] &= ~AMR_WB_TOC_F;
+        return packer->pos;
+    }
+    else
+    {
+        int len = (packer->pos + 7) >> 3;
+        put_bits(packer->packet, 4 + 6 * last, 0, 1);
+        // zero padding up to the octet boundary
+        if (packer->pos & 7)
+            put_bits(packer->packet, packer->pos, 0, 8 - (packer->pos & 7));
+        return len;
+    }
+}
+
+int amr_wb_rtp_depacketize(const uint8_t *packet, int len, int payload_format, int *cmr,
+                           uint8_t *frames, int capacity, int *frame_num)
+{
+    uint8_t tocs[MAX_FRAMES_PER_PACKET];
+    int n = 0;
+    int pos;
+    int out = 0;
+    int i;
+    int more = 1;
+    const int total_bits = len * 8;
+
+    if (payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+    {
+        if (len < 2)
+            return -1;
+        if (cmr) *cmr = packet[0] >> 4;
+        pos = 8;
+        while (more)
+        {
+            if ((pos + 8 > total_bits) || (n >= MAX_FRAMES_PER_PACKET))
+                return -1;
+            more = packet[pos >> 3] & AMR_WB_TOC_F;
+            tocs[n++] = packet[pos >> 3];
+            pos += 8;
+        }
+    }
+    else
+    {
+        if (total_bits < 10)
+            return -1;
+        if (cmr) *cmr = (int)get_bits(packet, 0, 4);
+        pos = 4;
+        while (more)
+        {
+            if ((pos + 6 > total_bits) || (n >= MAX_FRAMES_PER_PACKET))
+                return -1;
+            tocs[n] = (uint8_t)(get_bits(packet, pos, 6) << 2);
+            more = tocs[n] & AMR_WB_TOC_F;
+            n++;
+            pos += 6;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        int ft = AMR_WB_TOC_FT(tocs[i]);
+        int bits = frame_bits[ft];
+        int bytes = frame_bytes(ft);
+
+        if (is_reserved(ft))
+        {
+            // frame data of unknown length (RFC 4867, 4.3.2): neither this frame
+            // nor the following ones can be located, so all of them become NO_DATA.
+            if (out + (n - i) > capacity)
+                return -1;
+            for (; i < n; i++)
+                frames[out++] = TOC_NO_DATA;
+            break;
+        }
+
+        if (payload_format == AMR_WB_RTP_OCTET_ALIGNED)
+            bits = bytes * 8;
+        if (pos + bits > total_bits)
+            return -1;
+        if (out + 1 + bytes > capacity)
+            return -1;
+
+        frames[out++] = tocs[i] & TOC_FT_Q;
+        if (bytes > 0)
+        {
+            // clear the padding bits of the last octet
+            frames[out + bytes - 1] = 0;
+            copy_bits(frames, out * 8, packet, pos, frame_bits[ft]);
+        }
+        out += bytes;
+        pos += bits;
+    }
+
+    if (frame_num) *frame_num = n;
+    return out;
+}
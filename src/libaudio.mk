@@ -0,0 +1,51 @@
+# Sources of libaudio which are distributed as C, and are NOT in the prebuilt
+# libraries (GCC/*.lib, ARMClang/*.lib). Compile them with the application,
+# and link a prebuilt library for the rest (TTS engine, codecs).
+#
+# Set LIBAUDIO_ROOT to the root of this repository before including this file:
+#
+#   LIBAUDIO_ROOT = ../..
+#   include $(LIBAUDIO_ROOT)/src/libaudio.mk
+#
+#   CFLAGS += $(LIBAUDIO_INC)
+#   SRC    += $(LIBAUDIO_SRC)
+
+LIBAUDIO_ROOT ?= .
+
+LIBAUDIO_INC  = -I $(LIBAUDIO_ROOT)/include -I $(LIBAUDIO_ROOT)/src/tts -I $(LIBAUDIO_ROOT)/src/amr_wb
+
+# AMR-WB: stream decoder, concealment, rate control, resampler, RTP payload
+LIBAUDIO_AMR_WB_SRC = $(addprefix $(LIBAUDIO_ROOT)/src/amr_wb/, \
+    amr_wb_decoder_conceal.c    \
+    amr_wb_decoder_stream.c     \
+    amr_wb_encoder_info.c       \
+    amr_wb_rate_ctrl.c          \
+    amr_wb_resampler.c          \
+    amr_wb_rtp.c)
+
+# Opus: multistream encoder
+LIBAUDIO_OPUS_SRC   = $(LIBAUDIO_ROOT)/src/opus/opus_multistream_encoder.c
+
+# TTS: everything declared in tts.h after `tts_tune`;
+# tts_render.c includes ../amr_wb/amr_wb_priv.h
+LIBAUDIO_TTS_SRC    = $(addprefix $(LIBAUDIO_ROOT)/src/tts/, \
+    tts_encoder.c               \
+    tts_lexicon.c               \
+    tts_pitch.c                 \
+    tts_prefetch.c              \
+    tts_prompt_cache.c          \
+    tts_render.c                \
+    tts_speed.c                 \
+    tts_stream.c                \
+    tts_synth.c                 \
+    tts_template.c              \
+    tts_unit_cache.c            \
+    tts_window.c)
+
+LIBAUDIO_SRC        = $(LIBAUDIO_AMR_WB_SRC) $(LIBAUDIO_OPUS_SRC) $(LIBAUDIO_TTS_SRC)
+
+# ADPCM and SBC are also in the prebuilt libraries. Tools linking another
+# build of the engine (see tools/*/README.md) compile these, too.
+LIBAUDIO_CODEC_SRC  = $(LIBAUDIO_ROOT)/src/adpcm/audio_adpcm.c \
+    $(LIBAUDIO_ROOT)/src/sbc/sbc.c \
+    $(LIBAUDIO_ROOT)/src/sbc/bits.c
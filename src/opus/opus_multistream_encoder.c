@@ -0,0 +1,545 @@
+/* Copyright (c) 2011 Xiph.Org Foundation
+   Written by Jean-Marc Valin */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Multistream encoder built on top of the single-stream encoder in the
+   library. Surround analysis and the LFE stream of the reference
+   implementation are left out: the target is microphone arrays, where
+   every coded channel is a plain full-band channel. */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opus_multistream.h"
+
+#define MS_MAX_STREAMS      255
+
+/* Largest packet a single stream can produce (6 frames of 1275 bytes plus
+   the framing overhead), see the reference implementation. */
+#define MS_FRAME_TMP        (6 * 1275 + 12)
+
+#define MS_IMIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MS_IMAX(a, b)       ((a) > (b) ? (a) : (b))
+
+typedef struct
+{
+    int nb_channels;
+    int nb_streams;
+    int nb_coupled_streams;
+    unsigned char mapping[256];
+} ChannelLayout;
+
+struct OpusMSEncoder
+{
+    ChannelLayout layout;
+    opus_int32 Fs;
+    int application;
+    opus_int32 bitrate_bps;
+    /* Encoder states go here */
+};
+
+/* Internals of the library used to emit self-delimited packets and to
+   borrow the pseudostack set up by `opus_set_scratch_mem`. */
+extern opus_int32 opus_repacketizer_out_range_impl(OpusRepacketizer *rp, int begin, int end,
+      unsigned char *data, opus_int32 maxlen, int self_delimited, int pad,
+      const void *extensions, int nb_extensions);
+
+extern char *global_stack;
+extern char *scratch_ptr;
+extern int _opus_stack_max_size;
+extern int _opus_stack_max_usage;
+extern void opus_on_run_of_out_scratch_mem(const char *fn, int line_no);
+
+static void *ms_scratch_push(int size)
+{
+    char *p = (char *)(((size_t)global_stack + 7) & ~(size_t)7);
+    int used = (int)(p + size - scratch_ptr);
+    if (used > _opus_stack_max_size)
+    {
+        opus_on_run_of_out_scratch_mem(__FILE__, __LINE__);
+        return NULL;
+    }
+    if (used > _opus_stack_max_usage)
+        _opus_stack_max_usage = used;
+    global_stack = p + size;
+    return p;
+}
+
+static int align(int i)
+{
+    return (i + 7) & ~7;
+}
+
+static int get_channel(const ChannelLayout *layout, int coded, int prev)
+{
+    int i;
+    for (i = prev + 1; i < layout->nb_channels; i++)
+    {
+        if (layout->mapping[i] == coded)
+            return i;
+    }
+    return -1;
+}
+
+static int validate_layout(const ChannelLayout *layout)
+{
+    int i, s;
+    int max_channel = layout->nb_streams + layout->nb_coupled_streams;
+    if (max_channel > 255)
+        return 0;
+    for (i = 0; i < layout->nb_channels; i++)
+    {
+        if (layout->mapping[i] >= max_channel && layout->mapping[i] != 255)
+            return 0;
+    }
+    /* A coupled stream with an unused channel is never a good idea, and
+       every mono stream must be fed from somewhere. */
+    for (s = 0; s < layout->nb_coupled_streams; s++)
+    {
+        if (get_channel(layout, 2 * s, -1) == -1
+            || get_channel(layout, 2 * s + 1, -1) == -1)
+            return 0;
+    }
+    for (s = layout->nb_coupled_streams; s < layout->nb_streams; s++)
+    {
+        if (get_channel(layout, s + layout->nb_coupled_streams, -1) == -1)
+            return 0;
+    }
+    return 1;
+}
+
+static OpusEncoder *get_stream(OpusMSEncoder *st, int stream_id)
+{
+    int coupled_size = opus_encoder_get_size(2);
+    int mono_size = opus_encoder_get_size(1);
+    char *ptr = (char *)st + align(sizeof(OpusMSEncoder));
+    if (stream_id < st->layout.nb_coupled_streams)
+        return (OpusEncoder *)(ptr + stream_id * align(coupled_size));
+    ptr += st->layout.nb_coupled_streams * align(coupled_size);
+    return (OpusEncoder *)(ptr + (stream_id - st->layout.nb_coupled_streams) * align(mono_size));
+}
+
+opus_int32 opus_multistream_encoder_get_size(int nb_streams, int nb_coupled_streams)
+{
+    int coupled_size;
+    int mono_size;
+
+    if (nb_streams < 1 || nb_coupled_streams > nb_streams || nb_coupled_streams < 0)
+        return 0;
+    coupled_size = opus_encoder_get_size(2);
+    mono_size = opus_encoder_get_size(1);
+    return align(sizeof(OpusMSEncoder))
+         + nb_coupled_streams * align(coupled_size)
+         + (nb_streams - nb_coupled_streams) * align(mono_size);
+}
+
+int opus_multistream_encoder_init(
+      OpusMSEncoder *st,
+      opus_int32 Fs,
+      int channels,
+      int streams,
+      int coupled_streams,
+      const unsigned char *mapping,
+      int application)
+{
+    int i, ret;
+
+    if (channels > 255 || channels < 1 || coupled_streams > streams
+        || streams < 1 || coupled_streams < 0 || streams > MS_MAX_STREAMS - coupled_streams
+        || streams + coupled_streams > channels)
+        return OPUS_BAD_ARG;
+
+    st->layout.nb_channels = channels;
+    st->layout.nb_streams = streams;
+    st->layout.nb_coupled_streams = coupled_streams;
+    for (i = 0; i < st->layout.nb_channels; i++)
+        st->layout.mapping[i] = mapping[i];
+    if (!validate_layout(&st->layout))
+        return OPUS_BAD_ARG;
+
+    st->Fs = Fs;
+    st->application = application;
+    st->bitrate_bps = OPUS_AUTO;
+
+    for (i = 0; i < st->layout.nb_streams; i++)
+    {
+        ret = opus_encoder_init(get_stream(st, i), Fs,
+                                i < st->layout.nb_coupled_streams ? 2 : 1, application);
+        if (ret != OPUS_OK)
+            return ret;
+    }
+    return OPUS_OK;
+}
+
+OpusMSEncoder *opus_multistream_encoder_create(
+      opus_int32 Fs,
+      int channels,
+      int streams,
+      int coupled_streams,
+      const unsigned char *mapping,
+      int application,
+      int *error)
+{
+    int ret;
+    OpusMSEncoder *st;
+    if (channels > 255 || channels < 1 || coupled_streams > streams
+        || streams < 1 || coupled_streams < 0 || streams > MS_MAX_STREAMS - coupled_streams)
+    {
+        if (error)
+            *error = OPUS_BAD_ARG;
+        return NULL;
+    }
+    st = (OpusMSEncoder *)malloc(opus_multistream_encoder_get_size(streams, coupled_streams));
+    if (st == NULL)
+    {
+        if (error)
+            *error = OPUS_ALLOC_FAIL;
+        return NULL;
+    }
+    ret = opus_multistream_encoder_init(st, Fs, channels, streams, coupled_streams, mapping, application);
+    if (ret != OPUS_OK)
+    {
+        free(st);
+        st = NULL;
+    }
+    if (error)
+        *error = ret;
+    return st;
+}
+
+void opus_multistream_encoder_destroy(OpusMSEncoder *st)
+{
+    free(st);
+}
+
+/* Same split as the reference surround allocation with no LFE: every stream
+   pays a fixed overhead, and a coupled pair gets twice the rate of a mono
+   stream for the part above that. */
+static void rate_allocation(OpusMSEncoder *st, opus_int32 *rate, int frame_size)
+{
+    int i;
+    opus_int32 channel_rate;
+    opus_int32 stream_offset;
+    opus_int32 channel_offset;
+    opus_int32 bitrate;
+    opus_int32 total;
+    int nb_coupled = st->layout.nb_coupled_streams;
+    int nb_uncoupled = st->layout.nb_streams - nb_coupled;
+    int nb_normal = 2 * nb_coupled + nb_uncoupled;
+    const int coupled_ratio = 512; /* Q8 */
+
+    channel_offset = 40 * MS_IMAX(50, st->Fs / frame_size);
+    if (st->bitrate_bps == OPUS_AUTO)
+        bitrate = nb_normal * (channel_offset + st->Fs + 10000);
+    else if (st->bitrate_bps == OPUS_BITRATE_MAX)
+        bitrate = nb_normal * 300000;
+    else
+        bitrate = st->bitrate_bps;
+
+    stream_offset = (bitrate - channel_offset * nb_normal) / nb_normal / 2;
+    stream_offset = MS_IMAX(0, MS_IMIN(20000, stream_offset));
+
+    total = (nb_uncoupled << 8) + coupled_ratio * nb_coupled;
+    channel_rate = (opus_int32)(256 * (opus_int64)(bitrate
+                   - stream_offset * (nb_coupled + nb_uncoupled)
+                   - channel_offset * nb_normal) / total);
+
+    for (i = 0; i < st->layout.nb_streams; i++)
+    {
+        if (i < nb_coupled)
+            rate[i] = 2 * channel_offset + MS_IMAX(0, stream_offset + (channel_rate * coupled_ratio >> 8));
+        else
+            rate[i] = channel_offset + MS_IMAX(0, stream_offset + channel_rate);
+        rate[i] = MS_IMAX(rate[i], 500);
+    }
+}
+
+static int valid_frame_size(opus_int32 Fs, int frame_size)
+{
+    if (frame_size <= 0)
+        return 0;
+    return 400 * frame_size == Fs || 200 * frame_size == Fs || 100 * frame_size == Fs
+        || 50 * frame_size == Fs || 25 * frame_size == Fs || 50 * frame_size == 3 * Fs
+        || 50 * frame_size == 4 * Fs || 50 * frame_size == 5 * Fs || 50 * frame_size == 6 * Fs;
+}
+
+int opus_multistream_encode(
+    OpusMSEncoder *st,
+    const opus_int16 *pcm,
+    int frame_size,
+    unsigned char *data,
+    opus_int32 max_data_bytes)
+{
+    opus_int32 bitrates[MS_MAX_STREAMS];
+    opus_int16 *buf;
+    unsigned char *tmp_data;
+    OpusRepacketizer *rp;
+    char *saved_stack;
+    int smallest_packet;
+    int vbr;
+    int s, i;
+    int tot_size;
+    const int nb_channels = st->layout.nb_channels;
+    const int nb_streams = st->layout.nb_streams;
+
+    if (!valid_frame_size(st->Fs, frame_size))
+        return OPUS_BAD_ARG;
+
+    /* Smallest packet the encoder can produce. */
+    smallest_packet = nb_streams * 2 - 1;
+    /* 100 ms needs an extra byte per stream for the ToC. */
+    if (st->Fs / frame_size == 10)
+        smallest_packet += nb_streams;
+    if (max_data_bytes < smallest_packet)
+        return OPUS_BUFFER_TOO_SMALL;
+
+    opus_encoder_ctl(get_stream(st, 0), OPUS_GET_VBR(&vbr));
+
+    rate_allocation(st, bitrates, frame_size);
+    for (s = 0; s < nb_streams; s++)
+        opus_encoder_ctl(get_stream(st, s), OPUS_SET_BITRATE(bitrates[s]));
+
+    /* Temporaries live on the shared pseudostack, below whatever the stream
+       encoders push while running, and are released before returning. */
+    saved_stack = global_stack;
+    buf = (opus_int16 *)ms_scratch_push(2 * frame_size * sizeof(opus_int16));
+    /* No stream is encoded into more than MS_IMIN(max_data_bytes, MS_FRAME_TMP) bytes. */
+    tmp_data = (unsigned char *)ms_scratch_push(MS_IMIN(max_data_bytes, MS_FRAME_TMP));
+    rp = (OpusRepacketizer *)ms_scratch_push(opus_repacketizer_get_size());
+    if (buf == NULL || tmp_data == NULL || rp == NULL)
+    {
+        global_stack = saved_stack;
+        return OPUS_ALLOC_FAIL;
+    }
+
+    tot_size = 0;
+    for (s = 0; s < nb_streams; s++)
+    {
+        OpusEncoder *enc = get_stream(st, s);
+        int len;
+        int curr_max;
+        int c1, c2;
+        int ret;
+
+        if (s < st->layout.nb_coupled_streams)
+        {
+            c1 = get_channel(&st->layout, 2 * s, -1);
+            c2 = get_channel(&st->layout, 2 * s + 1, -1);
+            for (i = 0; i < frame_size; i++)
+            {
+                buf[2 * i]     = pcm[i * nb_channels + c1];
+                buf[2 * i + 1] = pcm[i * nb_channels + c2];
+            }
+        }
+        else
+        {
+            c1 = get_channel(&st->layout, s + st->layout.nb_coupled_streams, -1);
+            for (i = 0; i < frame_size; i++)
+                buf[i] = pcm[i * nb_channels + c1];
+        }
+
+        /* Number of bytes left (+ToC) */
+        curr_max = max_data_bytes - tot_size;
+        /* Reserve one byte for the last stream and two for the others */
+        curr_max -= MS_IMAX(0, 2 * (nb_streams - s - 1) - 1);
+        /* For 100 ms, reserve an extra byte per stream for the ToC */
+        if (st->Fs / frame_size == 10)
+            curr_max -= nb_streams - s - 1;
+        curr_max = MS_IMIN(curr_max, MS_FRAME_TMP);
+        /* Repacketizer will add one or two bytes for self-delimited frames */
+        if (s != nb_streams - 1)
+            curr_max -= curr_max > 253 ? 2 : 1;
+        if (!vbr && s == nb_streams - 1)
+            opus_encoder_ctl(enc, OPUS_SET_BITRATE(curr_max * (8 * st->Fs / frame_size)));
+
+        len = opus_encode(enc, buf, frame_size, tmp_data, curr_max);
+        if (len < 0)
+        {
+            global_stack = saved_stack;
+            return len;
+        }
+
+        opus_repacketizer_init(rp);
+        ret = opus_repacketizer_cat(rp, tmp_data, len);
+        if (ret != OPUS_OK)
+        {
+            global_stack = saved_stack;
+            return OPUS_INTERNAL_ERROR;
+        }
+        len = opus_repacketizer_out_range_impl(rp, 0, opus_repacketizer_get_nb_frames(rp),
+                                               data, max_data_bytes - tot_size,
+                                               s != nb_streams - 1, !vbr && s == nb_streams - 1,
+                                               NULL, 0);
+        if (len < 0)
+        {
+            global_stack = saved_stack;
+            return len;
+        }
+        data += len;
+        tot_size += len;
+    }
+
+    global_stack = saved_stack;
+    return tot_size;
+}
+
+int opus_multistream_encoder_ctl(OpusMSEncoder *st, int request, ...)
+{
+    va_list ap;
+    int s;
+    int ret = OPUS_OK;
+
+    va_start(ap, request);
+    switch (request)
+    {
+    case OPUS_SET_BITRATE_REQUEST:
+        {
+            opus_int32 value = va_arg(ap, opus_int32);
+            int nb_channels = st->layout.nb_streams + st->layout.nb_coupled_streams;
+            if (value != OPUS_AUTO && value != OPUS_BITRATE_MAX)
+            {
+                if (value <= 0)
+                {
+                    ret = OPUS_BAD_ARG;
+                    break;
+                }
+                value = MS_IMIN(300000 * nb_channels, MS_IMAX(500 * nb_channels, value));
+            }
+            st->bitrate_bps = value;
+        }
+        break;
+    case OPUS_GET_BITRATE_REQUEST:
+        {
+            opus_int32 *value = va_arg(ap, opus_int32 *);
+            if (!value)
+            {
+                ret = OPUS_BAD_ARG;
+                break;
+            }
+            *value = 0;
+            for (s = 0; s < st->layout.nb_streams; s++)
+            {
+                opus_int32 rate;
+                opus_encoder_ctl(get_stream(st, s), OPUS_GET_BITRATE(&rate));
+                *value += rate;
+            }
+        }
+        break;
+    case OPUS_GET_LSB_DEPTH_REQUEST:
+    case OPUS_GET_VBR_REQUEST:
+    case OPUS_GET_APPLICATION_REQUEST:
+    case OPUS_GET_BANDWIDTH_REQUEST:
+    case OPUS_GET_COMPLEXITY_REQUEST:
+    case OPUS_GET_PACKET_LOSS_PERC_REQUEST:
+    case OPUS_GET_DTX_REQUEST:
+    case OPUS_GET_VBR_CONSTRAINT_REQUEST:
+    case OPUS_GET_SIGNAL_REQUEST:
+    case OPUS_GET_LOOKAHEAD_REQUEST:
+    case OPUS_GET_SAMPLE_RATE_REQUEST:
+    case OPUS_GET_INBAND_FEC_REQUEST:
+    case OPUS_GET_FORCE_CHANNELS_REQUEST:
+    case OPUS_GET_PREDICTION_DISABLED_REQUEST:
+    case OPUS_GET_PHASE_INVERSION_DISABLED_REQUEST:
+    case OPUS_GET_EXPERT_FRAME_DURATION_REQUEST:
+        {
+            /* For int32* GET params, just query the first stream */
+            opus_int32 *value = va_arg(ap, opus_int32 *);
+            ret = opus_encoder_ctl(get_stream(st, 0), request, value);
+        }
+        break;
+    case OPUS_GET_FINAL_RANGE_REQUEST:
+        {
+            opus_uint32 *value = va_arg(ap, opus_uint32 *);
+            opus_uint32 tmp;
+            if (!value)
+            {
+                ret = OPUS_BAD_ARG;
+                break;
+            }
+            *value = 0;
+            for (s = 0; s < st->layout.nb_streams; s++)
+            {
+                ret = opus_encoder_ctl(get_stream(st, s), request, &tmp);
+                if (ret != OPUS_OK)
+                    break;
+                *value ^= tmp;
+            }
+        }
+        break;
+    case OPUS_SET_LSB_DEPTH_REQUEST:
+    case OPUS_SET_COMPLEXITY_REQUEST:
+    case OPUS_SET_VBR_REQUEST:
+    case OPUS_SET_VBR_CONSTRAINT_REQUEST:
+    case OPUS_SET_MAX_BANDWIDTH_REQUEST:
+    case OPUS_SET_BANDWIDTH_REQUEST:
+    case OPUS_SET_SIGNAL_REQUEST:
+    case OPUS_SET_APPLICATION_REQUEST:
+    case OPUS_SET_INBAND_FEC_REQUEST:
+    case OPUS_SET_PACKET_LOSS_PERC_REQUEST:
+    case OPUS_SET_DTX_REQUEST:
+    case OPUS_SET_FORCE_CHANNELS_REQUEST:
+    case OPUS_SET_PREDICTION_DISABLED_REQUEST:
+    case OPUS_SET_PHASE_INVERSION_DISABLED_REQUEST:
+    case OPUS_SET_EXPERT_FRAME_DURATION_REQUEST:
+        {
+            /* This works for int32 params */
+            opus_int32 value = va_arg(ap, opus_int32);
+            for (s = 0; s < st->layout.nb_streams; s++)
+            {
+                ret = opus_encoder_ctl(get_stream(st, s), request, value);
+                if (ret != OPUS_OK)
+                    break;
+            }
+        }
+        break;
+    case OPUS_MULTISTREAM_GET_ENCODER_STATE_REQUEST:
+        {
+            opus_int32 stream_id = va_arg(ap, opus_int32);
+            OpusEncoder **value = va_arg(ap, OpusEncoder **);
+            if (stream_id < 0 || stream_id >= st->layout.nb_streams || !value)
+            {
+                ret = OPUS_BAD_ARG;
+                break;
+            }
+            *value = get_stream(st, stream_id);
+        }
+        break;
+    case OPUS_RESET_STATE:
+        for (s = 0; s < st->layout.nb_streams; s++)
+        {
+            ret = opus_encoder_ctl(get_stream(st, s), OPUS_RESET_STATE);
+            if (ret != OPUS_OK)
+                break;
+        }
+        break;
+    default:
+        ret = OPUS_UNIMPLEMENTED;
+        break;
+    }
+    va_end(ap);
+    return ret;
+}
@@ -0,0 +1,202 @@
+#include "tts_priv.h"
+#include "sbc.h"
+#include "opus.h"
+#include "audio_adpcm.h"
+#include <string.h>
+
+// Samples are collected into a frame of the codec, which is encoded and
+// delivered as soon as it is full. With method #3, the synthesizer writes
+// samples into the frame directly.
+
+struct tts_encoder
+{
+    int codec;
+    int frame_samples;
+    int max_frame_bytes;
+    int fill;                   // samples in `pcm`
+    int size;                   // bytes in `frame` (ADPCM)
+    f_tts_receive_frame rx_frame;
+    void *user_data;
+    void *scratch;              // for SBC, in scratch memory 2
+    OpusEncoder *opus;
+    struct sbc_frame sbc_frame;
+    sbc_t sbc;
+    adpcm_enc_t adpcm;
+    int16_t *pcm;
+    uint8_t *frame;
+};
+
+#define ALIGN4(n)       (((n) + 3) & ~3)
+
+// SBC scratch follows a frame of changed speed, which may be still in scratch memory 2
+#define SBC_SCRATCH_OFFSET      ALIGN4(TTS_SPEED_FRAME_CAPACITY * sizeof(int16_t))
+
+// parameters of mSBC, which `sbc_encode2` uses when `msbc` is set
+static void setup_sbc_frame(struct sbc_frame *frame, const struct sbc_frame *config)
+{
+    *frame = *config;
+    if (!frame->msbc) return;
+    frame->mode = SBC_MODE_MONO;
+    frame->freq = SBC_FREQ_16K;
+    frame->bam = SBC_BAM_LOUDNESS;
+    frame->nsubbands = 8;
+    frame->nblocks = 15;
+    frame->bitpool = 26;
+}
+
+// Returns samples per frame, and bytes per frame at most, or 0 if `config` is invalid.
+static int frame_size(const struct tts_encoder_config *config, int *max_frame_bytes)
+{
+    struct sbc_frame frame;
+    int samples = config->frame_samples;
+
+    switch (config->codec)
+    {
+    case TTS_CODEC_ADPCM:
+        if ((samples <= 0) || (samples & 1)) return 0;
+        *max_frame_bytes = samples / 2;
+        return samples;
+    case TTS_CODEC_SBC:
+        if (config->sbc == NULL) return 0;
+        setup_sbc_frame(&frame, config->sbc);
+        if ((frame.freq != SBC_FREQ_16K) || (frame.mode != SBC_MODE_MONO)) return 0;
+        *max_frame_bytes = (int)sbc_get_frame_size(&frame);
+        if (*max_frame_bytes == 0) return 0;
+        if ((int)(SBC_SCRATCH_OFFSET + SBC_ENCODE_SCRATCH_MEM_SIZE) > tts_get_scratch_mem2_size()) return 0;
+        return frame.nblocks * frame.nsubbands;
+    case TTS_CODEC_OPUS:
+        if ((config->opus == NULL) || (config->max_frame_bytes <= 0)) return 0;
+        if ((samples != 40) && (samples != 80) && (samples != 160) && (samples != 320)
+            && (samples != 640) && (samples != 960))
+            return 0;
+        *max_frame_bytes = config->max_frame_bytes;
+        return samples;
+    default:
+        return 0;
+    }
+}
+
+int tts_encoder_get_size(const struct tts_encoder_config *config)
+{
+    int max_frame_bytes;
+    int samples = frame_size(config, &max_frame_bytes);
+
+    if (samples == 0) return 0;
+    return ALIGN4(sizeof(struct tts_encoder)) + samples * sizeof(int16_t) + max_frame_bytes;
+}
+
+static void adpcm_output(uint8_t output, void *param)
+{
+    struct tts_encoder *enc = (struct tts_encoder *)param;
+    enc->frame[enc->size++] = output;
+}
+
+struct tts_encoder *tts_encoder_init(const struct tts_encoder_config *config,
+    f_tts_receive_frame rx_frame, void *user_data, void *scratch2, void *buf)
+{
+    struct tts_encoder *enc = (struct tts_encoder *)buf;
+    int max_frame_bytes;
+    int samples = frame_size(config, &max_frame_bytes);
+
+    if (samples == 0) return NULL;
+
+    memset(enc, 0, sizeof(*enc));
+    enc->codec = config->codec;
+    enc->frame_samples = samples;
+    enc->max_frame_bytes = max_frame_bytes;
+    enc->rx_frame = rx_frame;
+    enc->user_data = user_data;
+    enc->scratch = (uint8_t *)scratch2 + SBC_SCRATCH_OFFSET;
+    enc->opus = config->opus;
+    enc->pcm = (int16_t *)((uint8_t *)buf + ALIGN4(sizeof(struct tts_encoder)));
+    enc->frame = (uint8_t *)(enc->pcm + samples);
+
+    if (enc->codec == TTS_CODEC_SBC)
+    {
+        setup_sbc_frame(&enc->sbc_frame, config->sbc);
+        sbc_reset(&enc->sbc);
+    }
+    else if (enc->codec == TTS_CODEC_ADPCM)
+        adpcm_enc_init(&enc->adpcm, adpcm_output, enc);
+
+    return enc;
+}
+
+// Encodes and delivers a full frame.
+// Returns 0, -1 if encoding fails, or the value returned by `rx_frame`.
+static int deliver(struct tts_encoder *enc)
+{
+    int size;
+
+    enc->fill = 0;
+    switch (enc->codec)
+    {
+    case TTS_CODEC_ADPCM:
+        enc->size = 0;
+        adpcm_encode(&enc->adpcm, enc->pcm, enc->frame_samples);
+        size = enc->size;
+        break;
+    case TTS_CODEC_SBC:
+        if (sbc_encode2(&enc->sbc, enc->pcm, 1, NULL, 0, &enc->sbc_frame,
+                        enc->frame, enc->max_frame_bytes, enc->scratch) != 0)
+            return -1;
+        size = enc->max_frame_bytes;
+        break;
+    default:
+        size = opus_encode(enc->opus, enc->pcm, enc->frame_samples, enc->frame, enc->max_frame_bytes);
+        if (size < 0) return -1;
+        break;
+    }
+
+    return enc->rx_frame(enc->frame, size, enc->user_data);
+}
+
+int tts_encoder_receive_pcm(struct tts_context *ctx, const int16_t *pcm_samples, int number,
+                            int acc_number, void *user_data)
+{
+    struct tts_encoder *enc = (struct tts_encoder *)user_data;
+
+    while (number > 0)
+    {
+        int n = enc->frame_samples - enc->fill;
+        int r;
+
+        if (n > number) n = number;
+        memcpy(enc->pcm + enc->fill, pcm_samples, n * sizeof(pcm_samples[0]));
+        enc->fill += n;
+        pcm_samples += n;
+        number -= n;
+
+        if (enc->fill < enc->frame_samples) break;
+        r = deliver(enc);
+        if (r != 0) return r;
+    }
+
+    return 0;
+}
+
+int tts_encoder_flush(struct tts_encoder *encoder)
+{
+    if (encoder->fill == 0) return 0;
+
+    memset(encoder->pcm + encoder->fill, 0, (encoder->frame_samples - encoder->fill) * sizeof(int16_t));
+    return deliver(encoder);
+}
+
+int tts_encoder_step(struct tts_encoder *encoder, struct tts_synth *synth)
+{
+    // SBC and Opus are set up for 16kHz
+    if ((encoder->codec != TTS_CODEC_ADPCM) && (tts_synth_output_rate(synth) != TTS_SAMPLE_RATE))
+        return -1;
+
+    while (encoder->fill < encoder->frame_samples)
+    {
+        // the synthesizer may just have caught up with pushed text:
+        // samples are kept until the frame is full, or flushed
+        int n = tts_synth_step(synth, encoder->pcm + encoder->fill, encoder->frame_samples - encoder->fill);
+        if (n == 0) return 0;
+        encoder->fill += n;
+    }
+
+    return deliver(encoder) == 0 ? 1 : -1;
+}
@@ -0,0 +1,58 @@
+#include "tts_priv.h"
+
+const struct lexicon_trie *tts_lexicon_trie(const struct voice_definition *voice)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    const uint8_t *end = (const uint8_t *)voice + h->unit_index;
+    const struct lexicon_trie_trailer *trailer = (const struct lexicon_trie_trailer *)end - 1;
+
+    if (trailer->magic != TTS_TRIE_MAGIC) return NULL;
+    if (trailer->size > h->unit_index - h->lexicon) return NULL;
+    return (const struct lexicon_trie *)(end - trailer->size);
+}
+
+int tts_lexicon_trie_match(const struct lexicon_trie *trie, const char *utf8_str, int max_bytes)
+{
+    const uint32_t *base = TTS_TRIE_BASE(trie);
+    const uint16_t *check = TTS_TRIE_CHECK(trie);
+    const uint8_t *s = (const uint8_t *)utf8_str;
+    uint32_t node = 0;
+    int len = 0;
+    int matched = 0;
+
+    // all characters of the trie are encoded in 3 bytes
+    while (len + 3 <= max_bytes)
+    {
+        uint32_t cp;
+        uint32_t code;
+        uint32_t next;
+
+        if (((s[0] & 0xf0) != 0xe0) || ((s[1] & 0xc0) != 0x80) || ((s[2] & 0xc0) != 0x80))
+            break;
+        cp = ((s[0] & 0x0fu) << 12) | ((s[1] & 0x3fu) << 6) | (s[2] & 0x3fu);
+        if ((cp < TTS_TRIE_FIRST_CHAR) || (cp >= TTS_TRIE_FIRST_CHAR + TTS_TRIE_CHAR_NUM))
+            break;
+
+        code = trie->codes[cp - TTS_TRIE_FIRST_CHAR];
+        next = base[node] & ~TTS_TRIE_END;
+        if ((code == 0) || (next == 0))
+            break;
+        next += code;
+        if ((next >= trie->node_num) || (check[next] != code))
+            break;
+
+        node = next;
+        s += 3;
+        len += 3;
+        if (base[node] & TTS_TRIE_END)
+            matched = len;
+    }
+
+    return matched;
+}
+
+int tts_lexicon_match(const struct voice_definition *voice, const char *utf8_str, int max_bytes)
+{
+    const struct lexicon_trie *trie = tts_lexicon_trie(voice);
+    return trie ? tts_lexicon_trie_match(trie, utf8_str, max_bytes) : -1;
+}
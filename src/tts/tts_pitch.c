@@ -0,0 +1,185 @@
+#include "tts_priv.h"
+#include <math.h>
+
+// Pitch period search by normalized cross-correlation (NCC).
+//
+// A wide range of lags is searched on a decimated signal first, then the
+// best lag is refined at full rate, so the cost is about 1/decim^2 of an
+// exhaustive search. Correlation is computed by dual 16-bit MACs (SMLALD
+// on Cortex-M4/M33, SSE2 or AVX2 on a host).
+
+#if !defined(TTS_PITCH_NO_SIMD)
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#define USE_SMLALD
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define USE_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+#endif
+
+// weight of lag `l` is (WEIGHT_SPAN * max - l)
+#ifndef WEIGHT_SPAN
+#define WEIGHT_SPAN     4
+#endif
+
+const char *tts_pitch_kernel_name(void)
+{
+#if defined(USE_SMLALD)
+    return "SMLALD";
+#elif defined(USE_AVX2)
+    return "AVX2";
+#elif defined(USE_SSE2)
+    return "SSE2";
+#else
+    return "C";
+#endif
+}
+
+// PMADDWD wraps only if both products of a pair are (-32768)^2, which is
+// harmless for a search.
+int64_t tts_pitch_dot(const int16_t *a, const int16_t *b, int n)
+{
+    int64_t acc = 0;
+    int i = 0;
+
+#if defined(USE_SMLALD)
+    // `a` and `b` may be unaligned, which LDR handles
+    for (; i + 2 <= n; i += 2)
+    {
+        int16x2_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        acc = __smlald(x, y, acc);
+    }
+#elif defined(USE_AVX2)
+    __m256i s = _mm256_setzero_si256();
+    int64_t lanes[4];
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i p = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                      _mm256_loadu_si256((const __m256i *)(b + i)));
+        s = _mm256_add_epi64(s, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+        s = _mm256_add_epi64(s, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, s);
+    acc = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(USE_SSE2)
+    __m128i s = _mm_setzero_si128();
+    int64_t lanes[2];
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i p = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + i)),
+                                   _mm_loadu_si128((const __m128i *)(b + i)));
+        __m128i sign = _mm_srai_epi32(p, 31);
+        s = _mm_add_epi64(s, _mm_unpacklo_epi32(p, sign));
+        s = _mm_add_epi64(s, _mm_unpackhi_epi32(p, sign));
+    }
+    _mm_storeu_si128((__m128i *)lanes, s);
+    acc = lanes[0] + lanes[1];
+#endif
+
+    for (; i < n; i++)
+        acc += (int32_t)a[i] * b[i];
+    return acc;
+}
+
+// Returns the lag in [lo, hi] with the largest NCC (0 if none is positive),
+// comparing x[0, n) with x[lag, lag + n), where n = len - hi. `score` is NCC^2.
+// With `favor_short` (a multiple of a lag is in range), scores are weighted
+// down by lag, so that a multiple of the period (which correlates as well)
+// is not chosen.
+static int best_lag(const int16_t *x, int len, int lo, int hi, int favor_short, float *score)
+{
+    int n = len - hi;
+    int64_t e0 = tts_pitch_dot(x, x, n);
+    int64_t e = tts_pitch_dot(x + lo, x + lo, n);
+    float best = 0;
+    float best_ncc2 = 0;
+    int lag = 0;
+    int l;
+
+    for (l = lo; l <= hi; l++)
+    {
+        int64_t c = tts_pitch_dot(x, x + l, n);
+        if ((c > 0) && (e > 0))
+        {
+            float s = (float)c * (float)c / (float)e;
+            float w = favor_short ? s * (float)(WEIGHT_SPAN * hi - l) : s;
+            if (w > best)
+            {
+                best = w;
+                best_ncc2 = s;
+                lag = l;
+            }
+        }
+        // energy of the next window
+        if (l < hi)
+            e += (int32_t)x[l + n] * x[l + n] - (int32_t)x[l] * x[l];
+    }
+
+    *score = e0 > 0 ? best_ncc2 / (float)e0 : 0;
+    return lag;
+}
+
+int tts_pitch_search(const int16_t *x, int len, int min_lag, int max_lag, int decim, int *ncc)
+{
+    int lo = min_lag;
+    int hi = max_lag;
+    float score;
+    int lag;
+
+    if ((min_lag < 1) || (max_lag < min_lag) || (len - max_lag < max_lag)) return 0;
+    if (decim > TTS_PITCH_MAX_DECIM) decim = TTS_PITCH_MAX_DECIM;
+
+    // coarse search at 1/decim of the rate: mean of each `decim` samples
+    if ((decim > 1) && (max_lag - min_lag > 4 * decim))
+    {
+        int16_t coarse[TTS_PITCH_MAX_COARSE];
+        int num = len / decim;
+        int i;
+        int j;
+
+        if (num > TTS_PITCH_MAX_COARSE) num = TTS_PITCH_MAX_COARSE;
+        for (i = 0; i < num; i++)
+        {
+            int32_t sum = 0;
+            for (j = 0; j < decim; j++)
+                sum += x[i * decim + j];
+            coarse[i] = (int16_t)(sum / decim);
+        }
+
+        lo = (min_lag + decim - 1) / decim;
+        lag = best_lag(coarse, num, lo, max_lag / decim, max_lag / decim >= 2 * lo, &score);
+        if (lag == 0) return 0;
+
+        // a short period is only a few coarse samples: try 1/2 and 1/3 of the lag
+        for (i = 2; i <= 3; i++)
+        {
+            float s;
+            int l = lag / i;
+            if (l + 1 < lo) break;
+            l = best_lag(coarse, num, l - 1 < lo ? lo : l - 1, l + 1, 0, &s);
+            if ((l > 0) && (s >= score * 0.8f))
+            {
+                lag = l;
+                score = s;
+                break;
+            }
+        }
+
+        lo = lag * decim - decim;
+        hi = lag * decim + decim;
+        if (lo < min_lag) lo = min_lag;
+        if (hi > max_lag) hi = max_lag;
+    }
+
+    lag = best_lag(x, len, lo, hi, hi >= 2 * lo, &score);
+    if (ncc) *ncc = score < 1 ? (int)(sqrtf(score) * 32767) : 32767;
+    return lag;
+}
@@ -0,0 +1,198 @@
+#include "tts_priv.h"
+#include <string.h>
+
+// Units are copied into a ring, one transfer at a time, in the order of
+// syllables. Slots are kept in a FIFO: the first one may be held by the unit
+// being decoded. A unit that is not ready when it is needed is read from
+// flash directly by the renderer, so the ring never stalls decoding.
+
+#define MAX_SLOTS               (TTS_PREFETCH_MAX_DEPTH + 1)
+
+struct prefetch_slot
+{
+    int16_t unit;
+    uint8_t ready;
+    uint8_t reserved;
+    int offset;
+    int len;
+};
+
+struct tts_prefetch
+{
+    f_tts_fetch fetch;
+    void *user_data;
+    const struct voice_definition *voice;
+    volatile uint8_t busy;      // a transfer is in progress
+    uint8_t held;               // the first slot is held by the unit being decoded
+    int8_t fetching;            // slot being transferred, or -1
+    uint8_t depth;
+    int next_index;             // next syllable to be fetched
+    int first;
+    int slot_num;
+    struct prefetch_slot slots[MAX_SLOTS];
+    int size;
+    int head;                   // end of the last slot in the ring
+    uint8_t *ring;
+};
+
+#define ALIGN4(n)       (((n) + 3) & ~3)
+
+#define SLOT(pf, i)     ((pf)->slots + ((pf)->first + (i)) % MAX_SLOTS)
+
+int tts_get_prefetch_size(const struct voice_definition *voice, int depth)
+{
+    int max_len = 0;
+    int unit;
+
+    if ((depth < 1) || (depth > TTS_PREFETCH_MAX_DEPTH)) return 0;
+
+    for (unit = 0; unit < (int)TTS_VOICE_UNIT_NUM(voice); unit++)
+    {
+        int len;
+        tts_voice_unit(voice, unit, &len);
+        if (len > max_len) max_len = len;
+    }
+
+    // the unit being decoded, `depth` units ahead, and the unused end of the ring
+    return ALIGN4(sizeof(struct tts_prefetch)) + (depth + 2) * max_len;
+}
+
+struct tts_prefetch *tts_prefetch_init(int size, int depth, f_tts_fetch fetch, void *user_data, void *buf)
+{
+    struct tts_prefetch *pf = (struct tts_prefetch *)buf;
+
+    if ((depth < 1) || (depth > TTS_PREFETCH_MAX_DEPTH)) return NULL;
+    if (size <= (int)ALIGN4(sizeof(struct tts_prefetch))) return NULL;
+
+    memset(pf, 0, sizeof(*pf));
+    pf->fetch = fetch;
+    pf->user_data = user_data;
+    pf->depth = (uint8_t)depth;
+    pf->fetching = -1;
+    pf->size = size - ALIGN4(sizeof(struct tts_prefetch));
+    pf->ring = (uint8_t *)buf + ALIGN4(sizeof(struct tts_prefetch));
+    return pf;
+}
+
+void tts_prefetch_complete(struct tts_prefetch *prefetch)
+{
+    prefetch->busy = 0;
+}
+
+// A transfer in progress is not cancelled. Its slot is dropped, and the next
+// transfer is not started before it completes, so data of later slots are
+// never overwritten.
+void tts_prefetch_reset(struct tts_prefetch *pf)
+{
+    pf->held = 0;
+    pf->fetching = -1;
+    pf->next_index = 0;
+    pf->first = 0;
+    pf->slot_num = 0;
+    pf->head = 0;
+}
+
+static void drop_first(struct tts_prefetch *pf)
+{
+    if (pf->fetching >= 0) pf->fetching--;
+    pf->first = (pf->first + 1) % MAX_SLOTS;
+    pf->slot_num--;
+    if (pf->slot_num == 0) pf->head = 0;
+}
+
+// returns offset in the ring, or -1
+static int ring_alloc(struct tts_prefetch *pf, int len)
+{
+    int tail = pf->slot_num > 0 ? SLOT(pf, 0)->offset : 0;
+
+    if ((pf->slot_num == 0) || (pf->head > tail))
+    {
+        if (pf->head + len <= pf->size) return pf->head;
+        return len <= tail ? 0 : -1;
+    }
+    return pf->head + len <= tail ? pf->head : -1;
+}
+
+void tts_prefetch_poll(struct tts_prefetch *pf, struct tts_context *ctx, int index)
+{
+    struct tts_context_head *head = TTS_CTX(ctx);
+
+    if (pf->voice != head->voice)
+    {
+        tts_prefetch_reset(pf);
+        pf->voice = head->voice;
+    }
+
+    if (pf->busy) return;
+    if (pf->fetching >= 0)
+    {
+        SLOT(pf, pf->fetching)->ready = 1;
+        pf->fetching = -1;
+    }
+
+    if (pf->next_index <= index) pf->next_index = index + 1;
+
+    while ((pf->next_index < head->syllable_num) && (pf->next_index <= index + pf->depth))
+    {
+        struct prefetch_slot *slot;
+        const uint8_t *src;
+        int unit = head->units[pf->next_index];
+        int len;
+        int offset;
+
+        if (unit < 0)
+        {
+            pf->next_index++;
+            continue;
+        }
+
+        if (pf->slot_num >= MAX_SLOTS) return;
+        src = tts_voice_unit(pf->voice, unit, &len);
+        offset = ring_alloc(pf, len);
+        if (offset < 0) return;
+
+        slot = SLOT(pf, pf->slot_num);
+        slot->unit = (int16_t)unit;
+        slot->ready = 0;
+        slot->offset = offset;
+        slot->len = len;
+        pf->head = offset + len;
+        pf->fetching = (int8_t)pf->slot_num;
+        pf->slot_num++;
+        pf->next_index++;
+
+        // the transfer may complete before `fetch` returns
+        pf->busy = 1;
+        if (pf->fetch(pf->ring + offset, src, len, pf->user_data) != 0)
+        {
+            pf->busy = 0;
+            pf->fetching = -1;
+            slot->unit = -1;
+        }
+        return;
+    }
+}
+
+const uint8_t *tts_prefetch_unit(struct tts_prefetch *pf, int unit, int *len)
+{
+    // the previous unit is decoded
+    if (pf->held)
+    {
+        drop_first(pf);
+        pf->held = 0;
+    }
+
+    while ((pf->slot_num > 0) && (pf->fetching != 0))
+    {
+        struct prefetch_slot *slot = SLOT(pf, 0);
+        if ((slot->unit == unit) && slot->ready)
+        {
+            pf->held = 1;
+            *len = slot->len;
+            return pf->ring + slot->offset;
+        }
+        drop_first(pf);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,218 @@
+#ifndef _tts_priv_h
+#define _tts_priv_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "tts.h"
+#include "amr_wb.h"
+
+// Leading fields of `struct tts_context` (layout of the prebuilt engine).
+struct tts_context_head
+{
+    const struct voice_definition *voice;
+    int max_syllables;
+    int syllable_num;
+    volatile uint8_t aborted;
+    uint8_t tune;               // trimming of units: 1/tune of a unit is cut at each joint
+    uint8_t reserved0[102];     // text front-end
+    int16_t *units;             // unit of each syllable, or (-n) for silence (see TTS_SILENCE_FRAMES)
+    uint8_t *flags;             // TTS_UNIT_TRIM_xxx of each syllable
+};
+
+#define TTS_CTX(ctx)                ((struct tts_context_head *)(ctx))
+
+// The prebuilt engine only exists for 32-bit Arm (GCC/, ARMClang/). Code that
+// doesn't touch a context (such as tools/pitch_bench) defines TTS_NO_ENGINE.
+#ifndef TTS_NO_ENGINE
+_Static_assert((sizeof(void *) == 4) && (offsetof(struct tts_context_head, units) == 116),
+               "struct tts_context_head only matches the prebuilt engine (32-bit Arm)");
+#endif
+
+#define TTS_UNIT_TRIM_HEAD          0x01
+#define TTS_UNIT_TRIM_TAIL          0x02
+
+// unit (-n) is rendered as (1 + n * TTS_SILENCE_FRAMES) frames of silence
+#define TTS_SILENCE_FRAMES          20
+
+#define TTS_FRAME_SAMPLES           AMR_WB_PCM_FRAME_16k
+
+// Header of voice definition: all offsets are from the beginning of the voice.
+struct voice_header
+{
+    uint32_t unit_num;          // units of syllables; more units follow (see TTS_VOICE_UNIT_NUM)
+    uint32_t syllable_num;
+    uint32_t syllable_table;
+    uint32_t char_table;
+    uint32_t lexicon;
+    uint32_t unit_index;        // uint32_t offset of each unit, relative to `unit_data`
+    uint32_t unit_data;         // each unit: int16_t byte length + MIME/IETF frames
+};
+
+#define TTS_VOICE_HEADER(voice)     ((const struct voice_header *)(voice))
+
+// Number of all units: the unit index is followed by unit data, and units
+// are stored in the order of the index.
+#define TTS_VOICE_UNIT_NUM(voice)   ((TTS_VOICE_HEADER(voice)->unit_data - TTS_VOICE_HEADER(voice)->unit_index) / sizeof(uint32_t))
+
+static inline const uint8_t *tts_voice_unit(const struct voice_definition *voice, int unit, int *len)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    const uint8_t *base = (const uint8_t *)voice;
+    const uint8_t *p = base + h->unit_data + ((const uint32_t *)(base + h->unit_index))[unit];
+    int16_t v;
+    memcpy(&v, p, sizeof(v));   // may be unaligned
+    *len = v;
+    return p + sizeof(v);
+}
+
+// Lexicon trie (tts_lexicon.c): an optional section of the voice definition,
+// right before the unit index, built by tools/voice_layout. It is a double
+// array of the words of the lexicon, where `check` holds the code of a node
+// (bases are unique):
+//
+// * struct lexicon_trie;
+// * uint32_t base[node_num]: children of node s are at base[s] + code, or none if 0;
+//   TTS_TRIE_END is set if a word ends at the node. The root is node 0;
+// * uint16_t check[node_num]: code of the node, padded to 4 bytes;
+// * struct lexicon_trie_trailer.
+#define TTS_TRIE_MAGIC              0x3154584c  // "LXT1"
+#define TTS_TRIE_FIRST_CHAR         0x4e00
+#define TTS_TRIE_CHAR_NUM           0x5200      // U+4E00 ~ U+9FFF
+#define TTS_TRIE_END                0x80000000u
+
+struct lexicon_trie
+{
+    uint32_t node_num;
+    uint16_t codes[TTS_TRIE_CHAR_NUM];          // code of each character, or 0 if not in any word
+};
+
+struct lexicon_trie_trailer
+{
+    uint32_t size;                              // size of the section, including the trailer
+    uint32_t magic;
+};
+
+#define TTS_TRIE_BASE(trie)         ((const uint32_t *)((trie) + 1))
+#define TTS_TRIE_CHECK(trie)        ((const uint16_t *)(TTS_TRIE_BASE(trie) + (trie)->node_num))
+
+// Returns the lexicon trie of a voice, or NULL.
+const struct lexicon_trie *tts_lexicon_trie(const struct voice_definition *voice);
+
+// Length in bytes of the longest word at the beginning of `utf8_str`, within `max_bytes`, or 0.
+int tts_lexicon_trie_match(const struct lexicon_trie *trie, const char *utf8_str, int max_bytes);
+
+// Appends a syllable (exported by the prebuilt engine).
+// Returns number of syllables, or -1 if the context is full.
+int tts_push_syllable(struct tts_context *ctx, int16_t unit, uint8_t flags);
+
+// Longest phrase pushed at once, in bytes. Longer phrases are split at a
+// character boundary.
+#define TTS_PHRASE_MAX_BYTES        120
+
+// Pushes the leading phrase of `utf8_str`, up to `max_bytes` (<= TTS_PHRASE_MAX_BYTES) bytes,
+// but at least one character.
+// Returns the remaining part, or NULL on error (see `tts_push_utf8_phrase`).
+const char *tts_push_utf8_phrase_n(struct tts_context *ctx, const char *utf8_str, int max_bytes);
+
+// Scratch memory 1: PCM of a frame followed by the decoder context.
+#define TTS_SCRATCH1_PCM(scratch1)  ((int16_t *)(scratch1))
+#define TTS_SCRATCH1_DEC(scratch1)  ((uint8_t *)(scratch1) + TTS_FRAME_SAMPLES * sizeof(int16_t))
+
+struct tts_unit_cache;
+struct tts_prefetch;
+
+// State of rendering syllables into 20ms frames. This is the open equivalent
+// of the synthesizer of method #2.
+struct tts_render
+{
+    struct tts_context *ctx;
+    struct tts_unit_cache *cache;
+    struct tts_prefetch *prefetch;
+    int16_t *pcm;
+    void *dec_buf;
+    void *scratch2;
+    struct amr_wb_decoder *dec;
+    int header_size;
+    int index;                  // current syllable
+    int silence;                // remaining frames of silence
+    int beep;                   // remaining frames of beep
+    int missing_unit;           // TTS_MISSING_UNIT_xxx
+    const uint8_t *stream;
+    const uint8_t *skip_end;
+    int remaining;
+    int entry;                  // cache entry being filled or played, or -1
+    int block;                  // next cache block to be played, or -1
+    int lag;                    // pitch lag of the last frame in samples, or 0 for silence
+    int from_flash;             // the unit being decoded is read from the voice definition
+    f_tts_clock clock;          // for statistics, or NULL
+    struct tts_stats stats;
+};
+
+void tts_render_init(struct tts_render *r, struct tts_context *ctx, struct tts_unit_cache *cache,
+                     void *scratch1, void *scratch2);
+
+static inline uint32_t tts_render_now(const struct tts_render *r)
+{
+    return r->clock ? r->clock() : 0;
+}
+
+// Returns the next 20ms frame, or NULL when all syllables are rendered.
+// The frame stays valid until the next call. Syllables appended to the
+// context later are picked up by the following calls.
+const int16_t *tts_render_next(struct tts_render *r);
+
+// Unit cache (tts_unit_cache.c)
+int tts_unit_cache_lookup(struct tts_unit_cache *cache, const struct voice_definition *voice,
+                          int unit, int flags, int tune);
+// returns -1 if `frames` (frames of the unit) do not fit in the whole cache
+int tts_unit_cache_begin(struct tts_unit_cache *cache, const struct voice_definition *voice,
+                         int unit, int flags, int tune, int frames);
+int16_t *tts_unit_cache_append(struct tts_unit_cache *cache, int entry);
+// sets pitch lag of the block appended last
+void tts_unit_cache_set_lag(struct tts_unit_cache *cache, int entry, int lag);
+void tts_unit_cache_end(struct tts_unit_cache *cache, int entry, int complete);
+int tts_unit_cache_first_block(const struct tts_unit_cache *cache, int entry);
+const int16_t *tts_unit_cache_block(const struct tts_unit_cache *cache, int block, int *next, int *lag);
+
+// Prefetching of units (tts_prefetch.c)
+void tts_prefetch_reset(struct tts_prefetch *prefetch);
+// starts the next transfer, if possible; `index` is the syllable being rendered
+void tts_prefetch_poll(struct tts_prefetch *prefetch, struct tts_context *ctx, int index);
+// returns data of a unit from the ring, or NULL if it is not ready
+const uint8_t *tts_prefetch_unit(struct tts_prefetch *prefetch, int unit, int *len);
+
+// Resumable synthesizer (tts_synth.c): sample rate of its output
+int tts_synth_output_rate(const struct tts_synth *synth);
+
+// Output of a 16kHz frame after change of speed has at most this many samples.
+// It fits into scratch memory 2.
+#define TTS_SPEED_FRAME_CAPACITY    (3 * TTS_FRAME_SAMPLES)
+
+// Changes speed of a frame of `len` samples in place (tts_speed.c).
+//
+// Whole pitch periods of `lag` samples are dropped (or repeated) while `*debt`,
+// the number of samples to be dropped (negative: to be added), allows, and
+// the frame fits into `capacity` samples.
+// A frame of silence (`lag` = 0) is just shortened or lengthened.
+// Returns the new length, and `*debt` is updated.
+int tts_speed_apply(int16_t *buf, int len, int lag, int capacity, int *debt);
+
+// Pitch period search (tts_pitch.c)
+
+#define TTS_PITCH_MAX_DECIM         12
+#define TTS_PITCH_MAX_COARSE        256     // samples of the decimated signal
+
+// decimation for a coarse search at about 4kHz
+#define TTS_PITCH_DECIM(rate)       ((rate) / 4000 < TTS_PITCH_MAX_DECIM ? (rate) / 4000 : TTS_PITCH_MAX_DECIM)
+
+// sum of a[i] * b[i]
+int64_t tts_pitch_dot(const int16_t *a, const int16_t *b, int n);
+// Finds the pitch period in [min_lag, max_lag] samples of `x`, where `len` >= 2 * `max_lag`.
+// A range wider than 4 * `decim` is searched at 1/`decim` of the rate first (`decim` = 1: at full rate only).
+// Returns the lag, or 0 if no lag correlates; `*ncc` (optional) is its normalized cross-correlation in Q15.
+int tts_pitch_search(const int16_t *x, int len, int min_lag, int max_lag, int decim, int *ncc);
+// SIMD extension used by `tts_pitch_dot`
+const char *tts_pitch_kernel_name(void);
+
+#endif
@@ -0,0 +1,428 @@
+#include "tts_priv.h"
+#include "audio_adpcm.h"
+#include <stddef.h>
+#include <string.h>
+
+// Layout of the region (NOR flash, erased to 0xFF, bits can only be cleared
+// by programming):
+//
+//   header | slots of the hash index | entries ... | free (0xFF)
+//
+// An entry is the text, its ADPCM data, and a trailer. The trailer is
+// programmed last, then the slot: a prompt interrupted while being stored
+// is never found, and its data are skipped. The free space begins after the
+// last programmed byte, so it is found again by scanning backwards.
+
+#define PROMPT_CACHE_MAGIC      0x31435250      // "PRC1"
+#define PROMPT_ENTRY_MAGIC      0x31455250      // "PRE1"
+#define ERASED                  0xFFFFFFFFu
+
+// one slot for each KB (about 0.12s of ADPCM at 16kHz)
+#define SLOT_BYTES              1024
+#define MIN_SLOTS               8
+
+#define WRITE_BUF_SIZE          32
+
+struct prompt_cache_header
+{
+    uint32_t magic;
+    uint32_t slot_num;
+    uint32_t tag;               // voice and tune of stored prompts, or ERASED
+    uint32_t reserved;
+};
+
+struct prompt_slot
+{
+    uint32_t hash;              // ERASED: empty
+    uint32_t trailer;           // offset of `struct prompt_entry`
+};
+
+// follows text and ADPCM data of a prompt
+struct prompt_entry
+{
+    uint32_t text_size;         // including '\0' and padding
+    uint32_t data_size;         // including padding
+    uint32_t samples;
+    uint32_t magic;
+};
+
+struct tts_prompt_cache
+{
+    const uint8_t *region;
+    int size;
+    f_tts_flash_program program;
+    f_tts_flash_erase erase;
+    void *user_data;
+    int slot_num;
+    int data_start;
+    int head;                   // start of free space
+    int prompts;
+    uint32_t too_long;          // hash of a prompt that overflowed an empty region, or ERASED
+    struct tts_prompt_cache_stats stats;
+
+    // a prompt being stored
+    f_tts_receive_pcm_samples rx_samples;
+    void *rx_user_data;
+    adpcm_enc_t enc;
+    int pos;                    // where `buf` goes
+    int fill;
+    int samples;
+    int overflow;
+    uint8_t buf[WRITE_BUF_SIZE];
+};
+
+#define ALIGN4(n)       (((n) + 3) & ~3)
+
+#define HEADER(cache)   ((const struct prompt_cache_header *)(cache)->region)
+#define SLOTS(cache)    ((const struct prompt_slot *)((cache)->region + sizeof(struct prompt_cache_header)))
+
+static uint32_t fnv1a(uint32_t h, const void *data, int size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int i;
+
+    for (i = 0; i < size; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static uint32_t text_hash(const char *utf8_str)
+{
+    uint32_t h = fnv1a(2166136261u, utf8_str, strlen(utf8_str));
+    return h == ERASED ? 0 : h;
+}
+
+static uint32_t voice_tag(struct tts_context *ctx)
+{
+    uint32_t h = fnv1a(2166136261u, TTS_VOICE_HEADER(TTS_CTX(ctx)->voice), sizeof(struct voice_header));
+    h = fnv1a(h, &TTS_CTX(ctx)->tune, 1);
+    return h == ERASED ? 0 : h;
+}
+
+static int format(struct tts_prompt_cache *cache)
+{
+    struct prompt_cache_header header;
+    int slot_num = cache->size / SLOT_BYTES;
+
+    if (slot_num < MIN_SLOTS) slot_num = MIN_SLOTS;
+    if ((int)(sizeof(header) + slot_num * sizeof(struct prompt_slot)) >= cache->size) return -1;
+
+    memset(&header, 0xff, sizeof(header));
+    header.magic = PROMPT_CACHE_MAGIC;
+    header.slot_num = slot_num;
+    if (cache->erase(cache->user_data) != 0) return -1;
+    return cache->program(0, &header, sizeof(header), cache->user_data);
+}
+
+static void scan(struct tts_prompt_cache *cache)
+{
+    const struct prompt_slot *slots = SLOTS(cache);
+    int i;
+
+    cache->slot_num = HEADER(cache)->slot_num;
+    cache->data_start = ALIGN4(sizeof(struct prompt_cache_header) + cache->slot_num * sizeof(struct prompt_slot));
+
+    cache->head = cache->size;
+    while ((cache->head > cache->data_start) && (cache->region[cache->head - 1] == 0xff))
+        cache->head--;
+    cache->head = ALIGN4(cache->head);
+
+    cache->prompts = 0;
+    for (i = 0; i < cache->slot_num; i++)
+        if (slots[i].hash != ERASED) cache->prompts++;
+}
+
+static int writable(const struct tts_prompt_cache *cache)
+{
+    return (cache->program != NULL) && (cache->erase != NULL);
+}
+
+int tts_get_prompt_cache_size(void)
+{
+    return sizeof(struct tts_prompt_cache);
+}
+
+struct tts_prompt_cache *tts_prompt_cache_init(const void *region, int size,
+    f_tts_flash_program program, f_tts_flash_erase erase, void *user_data, void *buf)
+{
+    struct tts_prompt_cache *cache = (struct tts_prompt_cache *)buf;
+    const struct prompt_cache_header *header = (const struct prompt_cache_header *)region;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->region = (const uint8_t *)region;
+    cache->size = size & ~3;
+    cache->program = program;
+    cache->erase = erase;
+    cache->user_data = user_data;
+    cache->too_long = ERASED;
+
+    if ((header->magic != PROMPT_CACHE_MAGIC)
+        || (header->slot_num < MIN_SLOTS)
+        || (sizeof(*header) + header->slot_num * sizeof(struct prompt_slot) >= (uint32_t)cache->size))
+    {
+        if (!writable(cache)) return NULL;
+        if (format(cache) != 0) return NULL;
+    }
+
+    scan(cache);
+    return cache;
+}
+
+int tts_prompt_cache_clear(struct tts_prompt_cache *cache)
+{
+    if (!writable(cache)) return -1;
+    if (format(cache) != 0) return -1;
+    cache->stats.evictions += cache->prompts;
+    scan(cache);
+    return 0;
+}
+
+void tts_prompt_cache_get_stats(const struct tts_prompt_cache *cache, struct tts_prompt_cache_stats *stats)
+{
+    *stats = cache->stats;
+    stats->prompts = cache->prompts;
+    stats->used_bytes = cache->head;
+}
+
+void tts_prompt_cache_reset_stats(struct tts_prompt_cache *cache)
+{
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+static const struct prompt_entry *lookup(const struct tts_prompt_cache *cache, const char *utf8_str)
+{
+    const struct prompt_slot *slots = SLOTS(cache);
+    uint32_t h = text_hash(utf8_str);
+    int i = h % cache->slot_num;
+    int n;
+
+    for (n = 0; n < cache->slot_num; n++, i = (i + 1) % cache->slot_num)
+    {
+        const struct prompt_entry *entry;
+
+        if (slots[i].hash == ERASED) break;
+        if (slots[i].hash != h) continue;
+
+        entry = (const struct prompt_entry *)(cache->region + slots[i].trailer);
+        if (strcmp((const char *)entry - entry->data_size - entry->text_size, utf8_str) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+struct player
+{
+    int16_t *pcm;
+    int fill;
+};
+
+static void rx_decoded(pcm_sample_t sample, void *param)
+{
+    struct player *player = (struct player *)param;
+    player->pcm[player->fill++] = sample;
+}
+
+// Frames are decoded into scratch memory 1.
+static int play(struct tts_context *ctx, const struct prompt_entry *entry,
+    f_tts_receive_pcm_samples rx_samples, void *user_data, void *scratch1)
+{
+    const uint8_t *data = (const uint8_t *)entry - entry->data_size;
+    struct player player = { (int16_t *)scratch1, 0 };
+    adpcm_dec_t dec;
+    int left = entry->samples;
+    int acc_number = 0;
+    int ret = 0;
+
+    adpcm_dec_init(&dec, rx_decoded, &player);
+
+    while (left > 0)
+    {
+        int n = left < TTS_FRAME_SAMPLES ? left : TTS_FRAME_SAMPLES;
+
+        player.fill = 0;
+        while (player.fill < n)
+            adpcm_decode(&dec, *data++);
+
+        ret = rx_samples(ctx, player.pcm, n, acc_number, user_data);
+        if (ret != 0) break;
+        acc_number += n;
+        left -= n;
+        if (TTS_CTX(ctx)->aborted) break;
+    }
+
+    return ret;
+}
+
+static void write_buf(struct tts_prompt_cache *cache)
+{
+    if (cache->fill == 0) return;
+
+    // room is kept for the trailer
+    if (cache->pos + cache->fill + (int)sizeof(struct prompt_entry) > cache->size)
+        cache->overflow = 1;
+    if (!cache->overflow && (cache->program(cache->pos, cache->buf, cache->fill, cache->user_data) != 0))
+        cache->overflow = 1;
+
+    if (!cache->overflow) cache->pos += cache->fill;
+    cache->fill = 0;
+}
+
+static void rx_encoded(uint8_t output, void *param)
+{
+    struct tts_prompt_cache *cache = (struct tts_prompt_cache *)param;
+
+    cache->buf[cache->fill++] = output;
+    if (cache->fill >= WRITE_BUF_SIZE)
+        write_buf(cache);
+}
+
+static int record(struct tts_context *ctx, const int16_t *pcm_samples, int number, int acc_number, void *user_data)
+{
+    struct tts_prompt_cache *cache = (struct tts_prompt_cache *)user_data;
+
+    if (!cache->overflow)
+    {
+        adpcm_encode(&cache->enc, pcm_samples, number);
+        cache->samples += number;
+    }
+    return cache->rx_samples(ctx, pcm_samples, number, acc_number, cache->rx_user_data);
+}
+
+// Returns 0 if there is room for the text and a few frames.
+static int begin_entry(struct tts_prompt_cache *cache, struct tts_context *ctx, const char *utf8_str)
+{
+    const struct prompt_cache_header *header = HEADER(cache);
+    int len = strlen(utf8_str) + 1;
+    int text_size = ALIGN4(len);
+    uint32_t tag = voice_tag(ctx);
+    static const uint8_t zeros[4] = {0};
+
+    // the whole region is erased when the voice changes or it is full
+    if (((header->tag != ERASED) && (header->tag != tag))
+        || (cache->prompts + 1 > cache->slot_num * 3 / 4)
+        || (cache->head + text_size + WRITE_BUF_SIZE + (int)sizeof(struct prompt_entry) > cache->size))
+    {
+        if (tts_prompt_cache_clear(cache) != 0) return -1;
+    }
+
+    if (cache->head + text_size + WRITE_BUF_SIZE + (int)sizeof(struct prompt_entry) > cache->size)
+        return -1;
+
+    if (HEADER(cache)->tag == ERASED)
+    {
+        if (cache->program(offsetof(struct prompt_cache_header, tag), &tag, sizeof(tag), cache->user_data) != 0)
+            return -1;
+    }
+
+    cache->pos = cache->head;
+    cache->fill = 0;
+    cache->samples = 0;
+    cache->overflow = 0;
+    if ((cache->program(cache->pos, utf8_str, len, cache->user_data) != 0)
+        || ((text_size > len) && (cache->program(cache->pos + len, zeros, text_size - len, cache->user_data) != 0)))
+    {
+        cache->head = cache->pos + text_size;
+        return -1;
+    }
+    cache->pos += text_size;
+    adpcm_enc_init(&cache->enc, rx_encoded, cache);
+    return 0;
+}
+
+static void end_entry(struct tts_prompt_cache *cache, const char *utf8_str, int complete)
+{
+    int text_size = ALIGN4(strlen(utf8_str) + 1);
+    int start = cache->head;
+    struct prompt_entry entry;
+    struct prompt_slot slot;
+    int i;
+
+    if (complete && !cache->overflow)
+    {
+        // the last sample of an odd number
+        if (cache->samples & 1)
+        {
+            pcm_sample_t pad = 0;
+            adpcm_encode(&cache->enc, &pad, 1);
+        }
+        while (cache->fill & 3)
+            cache->buf[cache->fill++] = 0;
+        write_buf(cache);
+    }
+
+    // data programmed so far are skipped in any case
+    cache->head = ALIGN4(cache->pos);
+    if (!complete) return;
+
+    if (cache->overflow)
+    {
+        // the prompt is stored when it is synthesized next time, unless it
+        // didn't fit even in an empty region: erasing again would not help
+        cache->stats.failures++;
+        if (start > cache->data_start)
+            tts_prompt_cache_clear(cache);
+        else
+            cache->too_long = text_hash(utf8_str);
+        return;
+    }
+
+    entry.text_size = text_size;
+    entry.data_size = cache->pos - start - text_size;
+    entry.samples = cache->samples;
+    entry.magic = PROMPT_ENTRY_MAGIC;
+    if (cache->program(cache->pos, &entry, sizeof(entry), cache->user_data) != 0)
+    {
+        cache->stats.failures++;
+        cache->head = cache->pos + sizeof(entry);
+        return;
+    }
+
+    slot.hash = text_hash(utf8_str);
+    slot.trailer = cache->pos;
+    cache->head = cache->pos + sizeof(entry);
+
+    i = slot.hash % cache->slot_num;
+    while (SLOTS(cache)[i].hash != ERASED)
+        i = (i + 1) % cache->slot_num;
+    if (cache->program((const uint8_t *)(SLOTS(cache) + i) - cache->region, &slot, sizeof(slot),
+                       cache->user_data) != 0)
+    {
+        cache->stats.failures++;
+        return;
+    }
+    cache->prompts++;
+    cache->stats.stored++;
+}
+
+int tts_synthesize_prompt(struct tts_context *ctx, struct tts_prompt_cache *cache, const char *utf8_str,
+    struct tts_unit_cache *unit_cache, f_tts_receive_pcm_samples rx_samples, void *user_data,
+    void *scratch1, void *scratch2)
+{
+    const struct prompt_entry *entry = NULL;
+    int recording;
+    int ret;
+
+    TTS_CTX(ctx)->aborted = 0;
+
+    if ((HEADER(cache)->tag == voice_tag(ctx)) && ((entry = lookup(cache, utf8_str)) != NULL))
+    {
+        cache->stats.hits++;
+        return play(ctx, entry, rx_samples, user_data, scratch1);
+    }
+
+    cache->stats.misses++;
+    tts_reset(ctx);
+    if (tts_push_utf8_str(ctx, utf8_str) != 0) return -1;
+
+    recording = writable(cache) && (text_hash(utf8_str) != cache->too_long)
+                && (begin_entry(cache, ctx, utf8_str) == 0);
+    if (!recording)
+        return tts_synthesize_cached(ctx, unit_cache, rx_samples, user_data, scratch1, scratch2,
+                                     NULL, NULL);
+
+    cache->rx_samples = rx_samples;
+    cache->rx_user_data = user_data;
+    ret = tts_synthesize_cached(ctx, unit_cache, record, cache, scratch1, scratch2, NULL, NULL);
+    end_entry(cache, utf8_str, (ret == 0) && !TTS_CTX(ctx)->aborted);
+    return ret;
+}
@@ -0,0 +1,257 @@
+#include "tts_priv.h"
+#include "../amr_wb/amr_wb_priv.h"
+#include <string.h>
+
+// Rendering of syllables, frame by frame. Output is identical to `tts_synthesize`:
+//
+// * a unit is decoded with a freshly initialized decoder;
+// * 1/tune of the unit is cut from the head and/or the tail according to its flags;
+// * frames in the cut head are probed but not decoded.
+
+void tts_render_init(struct tts_render *r, struct tts_context *ctx, struct tts_unit_cache *cache,
+                     void *scratch1, void *scratch2)
+{
+    memset(r, 0, sizeof(*r));
+    r->ctx = ctx;
+    r->cache = cache;
+    r->pcm = TTS_SCRATCH1_PCM(scratch1);
+    r->dec_buf = TTS_SCRATCH1_DEC(scratch1);
+    r->scratch2 = scratch2;
+    r->header_size = amr_wb_get_frame_header_size(AMR_WB_BIT_STREAM_FORMAT_MIME_IETF);
+    r->index = -1;
+    r->entry = -1;
+    r->block = -1;
+}
+
+// a missing unit is played as 1kHz beep of 160ms
+#define BEEP_FRAMES         8
+#define BEEP_PERIOD         16
+#define BEEP_RAMP           80
+
+static const int16_t beep_wave[BEEP_PERIOD] =
+{
+    0, 3061, 5657, 7391, 8000, 7391, 5657, 3061, 0, -3061, -5657, -7391, -8000, -7391, -5657, -3061,
+};
+
+static void beep_frame(struct tts_render *r)
+{
+    int pos = (BEEP_FRAMES - r->beep) * TTS_FRAME_SAMPLES;
+    int end = BEEP_FRAMES * TTS_FRAME_SAMPLES;
+    int i;
+
+    for (i = 0; i < TTS_FRAME_SAMPLES; i++, pos++)
+    {
+        int v = beep_wave[i % BEEP_PERIOD];
+        if (pos < BEEP_RAMP)
+            v = v * pos / BEEP_RAMP;
+        else if (pos >= end - BEEP_RAMP)
+            v = v * (end - 1 - pos) / BEEP_RAMP;
+        r->pcm[i] = (int16_t)v;
+    }
+}
+
+// pitch lag of the frame just decoded, converted from 12.8kHz to 16kHz
+static int decoded_lag(const struct amr_wb_decoder *dec)
+{
+    int t0 = *(const int16_t *)((const uint8_t *)dec + AMR_WB_DEC_OLD_T0);
+    return (t0 * 5 + 2) / 4;
+}
+
+static void start_decoding(struct tts_render *r, int unit, int flags, int tune)
+{
+    int len;
+    int trim;
+    const uint8_t *p = r->prefetch ? tts_prefetch_unit(r->prefetch, unit, &len) : NULL;
+
+    r->from_flash = p == NULL;
+    if (r->from_flash)
+    {
+        p = tts_voice_unit(TTS_CTX(r->ctx)->voice, unit, &len);
+        r->stats.flash_bytes += sizeof(int16_t);
+    }
+    if (len == 0) r->stats.missing_units++;
+
+    r->dec = amr_wb_decoder_init(AMR_WB_BIT_STREAM_FORMAT_MIME_IETF, r->dec_buf);
+
+    trim = len / tune;
+    if (flags & TTS_UNIT_TRIM_TAIL)
+        len -= trim;
+    r->skip_end = p;
+    if (flags & TTS_UNIT_TRIM_HEAD)
+    {
+        len -= trim;
+        r->skip_end = p + trim;
+    }
+
+    while ((len > r->header_size) && (p < r->skip_end))
+    {
+        int n = amr_wb_decoder_probe(r->dec, p);
+        p += r->header_size;
+        len -= r->header_size;
+        if (r->from_flash) r->stats.flash_bytes += r->header_size;
+        if (n >= 0)
+        {
+            p += n;
+            len -= n;
+        }
+    }
+
+    r->stream = p;
+    r->remaining = len;
+}
+
+// frames left in the unit being decoded, by probing their headers
+static int count_frames(struct tts_render *r)
+{
+    const uint8_t *p = r->stream;
+    int len = r->remaining;
+    int frames = 0;
+
+    while (len >= r->header_size)
+    {
+        int n = amr_wb_decoder_probe(r->dec, p);
+        p += r->header_size;
+        len -= r->header_size;
+        if (r->from_flash) r->stats.flash_bytes += r->header_size;
+        if (n < 0) continue;
+        p += n;
+        len -= n;
+        frames++;
+    }
+    return frames;
+}
+
+// returns 0 when there is no more syllables
+static int next_unit(struct tts_render *r)
+{
+    struct tts_context_head *ctx = TTS_CTX(r->ctx);
+    int unit;
+    int flags;
+
+    // syllables may be appended later: stay at the last one
+    r->remaining = 0;
+    if (r->index + 1 >= ctx->syllable_num)
+        return 0;
+    r->index++;
+    if (r->prefetch)
+        tts_prefetch_poll(r->prefetch, r->ctx, r->index);
+
+    unit = ctx->units[r->index];
+    if (unit < 0)
+    {
+        memset(r->pcm, 0, TTS_FRAME_SAMPLES * sizeof(r->pcm[0]));
+        r->silence = 1 - unit * TTS_SILENCE_FRAMES;
+        return 1;
+    }
+
+    // units missing from a subset voice are empty
+    if (r->missing_unit == TTS_MISSING_UNIT_BEEP)
+    {
+        int len;
+        tts_voice_unit(ctx->voice, unit, &len);
+        if (len == 0)
+        {
+            r->stats.units++;
+            r->stats.missing_units++;
+            r->beep = BEEP_FRAMES;
+            return 1;
+        }
+    }
+
+    r->stats.units++;
+    flags = ctx->flags[r->index] & (TTS_UNIT_TRIM_HEAD | TTS_UNIT_TRIM_TAIL);
+
+    if (r->cache)
+    {
+        int e = tts_unit_cache_lookup(r->cache, ctx->voice, unit, flags, ctx->tune);
+        if (e >= 0)
+        {
+            r->stats.cache_hits++;
+            r->block = tts_unit_cache_first_block(r->cache, e);
+            return 1;
+        }
+    }
+
+    start_decoding(r, unit, flags, ctx->tune);
+    if (r->cache)
+        r->entry = tts_unit_cache_begin(r->cache, ctx->voice, unit, flags, ctx->tune, count_frames(r));
+    return 1;
+}
+
+const int16_t *tts_render_next(struct tts_render *r)
+{
+    uint32_t t = tts_render_now(r);
+    int more;
+
+    if (r->prefetch)
+    {
+        tts_prefetch_poll(r->prefetch, r->ctx, r->index);
+        r->stats.lookup_time += tts_render_now(r) - t;
+    }
+
+    for (;;)
+    {
+        if (r->silence > 0)
+        {
+            r->silence--;
+            r->lag = 0;
+            return r->pcm;
+        }
+
+        if (r->beep > 0)
+        {
+            beep_frame(r);
+            r->beep--;
+            r->lag = BEEP_PERIOD;
+            return r->pcm;
+        }
+
+        if (r->block >= 0)
+            return tts_unit_cache_block(r->cache, r->block, &r->block, &r->lag);
+
+        while (r->remaining >= r->header_size)
+        {
+            int16_t *out = NULL;
+            int n = amr_wb_decoder_probe(r->dec, r->stream);
+            r->stream += r->header_size;
+            r->remaining -= r->header_size;
+            if (n < 0) continue;
+
+            if (r->entry >= 0)
+            {
+                out = tts_unit_cache_append(r->cache, r->entry);
+                if (out == NULL)
+                {
+                    // the unit does not fit into the cache
+                    tts_unit_cache_end(r->cache, r->entry, 0);
+                    r->entry = -1;
+                }
+            }
+            if (out == NULL) out = r->pcm;
+
+            t = tts_render_now(r);
+            amr_wb_decoder_decode_frame(r->dec, r->stream, out, r->scratch2);
+            r->stats.decode_time += tts_render_now(r) - t;
+            r->stats.decoded_frames++;
+            if (r->from_flash) r->stats.flash_bytes += r->header_size + n;
+            r->lag = decoded_lag(r->dec);
+            if (out != r->pcm)
+                tts_unit_cache_set_lag(r->cache, r->entry, r->lag);
+            r->stream += n;
+            r->remaining -= n;
+            return out;
+        }
+
+        if (r->entry >= 0)
+        {
+            tts_unit_cache_end(r->cache, r->entry, 1);
+            r->entry = -1;
+        }
+
+        t = tts_render_now(r);
+        more = next_unit(r);
+        r->stats.lookup_time += tts_render_now(r) - t;
+        if (!more)
+            return NULL;
+    }
+}
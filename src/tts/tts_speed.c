@@ -0,0 +1,68 @@
+#include "tts_priv.h"
+#include <string.h>
+
+// Change of speed with pitch periods known by the decoder.
+//
+// A period is dropped by cross-fading from the signal into the signal one
+// period later, and repeated by cross-fading into the signal one period
+// earlier. Both ends of a frame are kept, so frames still join smoothly.
+
+// cross-fades from `a` into `b`; `out` may be the same as `a` or `b`
+static void cross_fade(int16_t *out, const int16_t *a, const int16_t *b, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        int32_t w = (i << 15) / len;
+        out[i] = (int16_t)((a[i] * (32768 - w) + b[i] * w) >> 15);
+    }
+}
+
+static int change_silence(int16_t *buf, int len, int capacity, int *debt)
+{
+    int n = len - *debt;
+    if (n < 0) n = 0;
+    if (n > capacity) n = capacity;
+    if (n > len)
+        memset(buf + len, 0, (n - len) * sizeof(buf[0]));
+    *debt -= len - n;
+    return n;
+}
+
+int tts_speed_apply(int16_t *buf, int len, int lag, int capacity, int *debt)
+{
+    int d;
+
+    if (lag <= 0)
+        return change_silence(buf, len, capacity, debt);
+
+    // The lag of the decoder is an integer at 12.8kHz (scaled to the output
+    // rate), so it is refined within a few percent when a period is due.
+    d = lag / 16 + 1;
+    if ((2 * (*debt < 0 ? -*debt : *debt) >= lag) && (2 * (lag + d) <= len))
+    {
+        int refined = tts_pitch_search(buf, len, lag - d, lag + d, 1, NULL);
+        if (refined > 0) lag = refined;
+    }
+
+    // a period is dropped (or repeated) once at least half of it is due
+    while ((2 * *debt >= lag) && (2 * lag <= len))
+    {
+        int p = (len - 2 * lag) / 2;
+        cross_fade(buf + p, buf + p, buf + p + lag, lag);
+        memmove(buf + p + lag, buf + p + 2 * lag, (len - p - 2 * lag) * sizeof(buf[0]));
+        len -= lag;
+        *debt -= lag;
+    }
+
+    while ((-2 * *debt >= lag) && (2 * lag <= len) && (len + lag <= capacity))
+    {
+        int p = len / 2;
+        memmove(buf + p + lag, buf + p, (len - p) * sizeof(buf[0]));
+        cross_fade(buf + p, buf + p + lag, buf + p - lag, lag);
+        len += lag;
+        *debt += lag;
+    }
+
+    return len;
+}
@@ -0,0 +1,191 @@
+#include "tts_priv.h"
+#include <string.h>
+
+// An invalid or truncated sequence counts as 1 byte, so '\0' is never skipped.
+static int utf8_char_len(const char *s)
+{
+    const uint8_t *u = (const uint8_t *)s;
+    int n;
+    int i;
+
+    if (u[0] < 0x80) return 1;
+    else if ((u[0] & 0xe0) == 0xc0) n = 2;
+    else if ((u[0] & 0xf0) == 0xe0) n = 3;
+    else if ((u[0] & 0xf8) == 0xf0) n = 4;
+    else return 1;
+
+    for (i = 1; i < n; i++)
+        if ((u[i] & 0xc0) != 0x80) return 1;
+    return n;
+}
+
+static int is_digit(char c)
+{
+    return (c >= '0') && (c <= '9');
+}
+
+// length of the phrase break at `s`, or 0 if `s` is not a phrase break.
+static int phrase_break_len(const char *s, const char *start)
+{
+    const uint8_t *u = (const uint8_t *)s;
+
+    switch (s[0])
+    {
+    case ',':
+    case '.':
+    case ':':
+        // separators within numbers, such as "1,000.50" and "12:30"
+        if ((s > start) && is_digit(s[-1]) && is_digit(s[1]))
+            return 0;
+        return 1;
+    case ';':
+    case '!':
+    case '?':
+    case '\n':
+        return 1;
+    default:
+        break;
+    }
+
+    // ，；：！？ (U+FF0C, U+FF1B, U+FF1A, U+FF01, U+FF1F)
+    if ((u[0] == 0xef) && (u[1] == 0xbc)
+        && ((u[2] == 0x8c) || (u[2] == 0x9b) || (u[2] == 0x9a) || (u[2] == 0x81) || (u[2] == 0x9f)))
+        return 3;
+    // 、。 (U+3001, U+3002)
+    if ((u[0] == 0xe3) && (u[1] == 0x80) && ((u[2] == 0x81) || (u[2] == 0x82)))
+        return 3;
+
+    return 0;
+}
+
+const char *tts_push_utf8_phrase_n(struct tts_context *ctx, const char *utf8_str, int max_bytes)
+{
+    char phrase[TTS_PHRASE_MAX_BYTES + 1];
+    const struct lexicon_trie *trie = tts_lexicon_trie(TTS_CTX(ctx)->voice);
+    const char *s = utf8_str;
+    int in_pinyin = 0;
+    int len;
+
+    if (max_bytes > TTS_PHRASE_MAX_BYTES) max_bytes = TTS_PHRASE_MAX_BYTES;
+
+    while (*s)
+    {
+        int n = utf8_char_len(s);
+        int brk = in_pinyin ? 0 : phrase_break_len(s, utf8_str);
+
+        if (brk > 0)
+        {
+            // following breaks belong to this phrase, too
+            const char *e = s + brk;
+            while ((brk = phrase_break_len(e, utf8_str)) > 0) e += brk;
+            if (e - utf8_str <= max_bytes)
+                s = e;
+            else if (s == utf8_str)
+            {
+                // a run of breaks longer than a phrase: take as many as fit, at least one
+                s += phrase_break_len(s, utf8_str);
+                while (((brk = phrase_break_len(s, utf8_str)) > 0) && (s + brk - utf8_str <= max_bytes))
+                    s += brk;
+            }
+            break;
+        }
+
+        if (*s == '[') in_pinyin = 1;
+        else if (*s == ']') in_pinyin = 0;
+
+        // a long phrase is cut between words; the first word is the longest one that fits
+        if (trie && !in_pinyin)
+        {
+            int w = tts_lexicon_trie_match(trie, s, s > utf8_str ? TTS_PHRASE_MAX_BYTES : max_bytes);
+            if (w > 0) n = w;
+        }
+
+        // a phrase has at least one character
+        if ((s > utf8_str) && (s + n - utf8_str > max_bytes))
+            break;
+        s += n;
+    }
+
+    len = (int)(s - utf8_str);
+    if (len == 0) return s;
+
+    memcpy(phrase, utf8_str, len);
+    phrase[len] = '\0';
+    if (tts_push_utf8_str(ctx, phrase) != 0)
+        return NULL;
+    return s;
+}
+
+const char *tts_push_utf8_phrase(struct tts_context *ctx, const char *utf8_str)
+{
+    return tts_push_utf8_phrase_n(ctx, utf8_str, TTS_PHRASE_MAX_BYTES);
+}
+
+static uint32_t now(f_tts_clock clock)
+{
+    return clock ? clock() : 0;
+}
+
+int tts_synthesize_stream(struct tts_context *ctx, const char *utf8_str, struct tts_unit_cache *cache,
+    f_tts_receive_pcm_samples rx_samples, void *user_data, void *scratch1, void *scratch2,
+    f_tts_clock clock, struct tts_stream_stats *stats)
+{
+    struct tts_stream_stats local;
+    struct tts_render r;
+    const int16_t *pcm;
+    const char *rest;
+    int acc_number = 0;
+    int ret = 0;
+    uint32_t start = now(clock);
+    uint32_t t;
+
+    if (stats == NULL) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    tts_reset(ctx);
+    TTS_CTX(ctx)->aborted = 0;
+    tts_render_init(&r, ctx, cache, scratch1, scratch2);
+    r.clock = clock;
+
+    for (;;)
+    {
+        pcm = tts_render_next(&r);
+        if (pcm == NULL)
+        {
+            // all resolved syllables are rendered: resolve the next phrase
+            if (*utf8_str == '\0') break;
+
+            t = now(clock);
+            rest = tts_push_utf8_phrase(ctx, utf8_str);
+            stats->analysis_time += now(clock) - t;
+            // each phrase consumes text, or synthesis would never end
+            if ((rest == NULL) || (rest == utf8_str))
+            {
+                ret = -1;
+                break;
+            }
+            utf8_str = rest;
+            stats->phrases++;
+            continue;
+        }
+
+        if (acc_number == 0)
+            stats->time_to_first_sample = now(clock) - start;
+
+        ret = rx_samples(ctx, pcm, TTS_FRAME_SAMPLES, acc_number, user_data);
+        if (ret != 0) break;
+        acc_number += TTS_FRAME_SAMPLES;
+        if (TTS_CTX(ctx)->aborted) break;
+    }
+
+    if (r.entry >= 0)
+        tts_unit_cache_end(cache, r.entry, 0);
+
+    stats->syllables = TTS_CTX(ctx)->syllable_num;
+    stats->samples = acc_number;
+    stats->synth = r.stats;
+    stats->synth.samples = acc_number;
+    stats->synth.analysis_time = stats->analysis_time;
+    stats->total_time = now(clock) - start;
+    return ret;
+}
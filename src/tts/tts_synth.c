@@ -0,0 +1,294 @@
+#include "tts_priv.h"
+#include <string.h>
+
+struct tts_synth
+{
+    struct tts_render render;
+    void *scratch1;
+    const int16_t *frame;       // frame being output
+    int frame_len;
+    int offset;                 // samples of `frame` already output
+    int speed;                  // Q8
+    int debt;                   // samples to be dropped (negative: to be added), Q8
+    int capacity;               // of a frame after change of speed, in samples
+    int fade_out;               // length of fade-out when aborted, in samples
+    int fade_left;              // samples left to fade out, or -1 if not fading
+    int fade_len;               // length of the current fade-out
+    struct amr_wb_resampler rs;
+};
+
+int tts_synth_get_size(void)
+{
+    return sizeof(struct tts_synth);
+}
+
+struct tts_synth *tts_synth_init(struct tts_context *ctx, struct tts_unit_cache *cache,
+                                 void *scratch1, void *scratch2, void *buf)
+{
+    struct tts_synth *synth = (struct tts_synth *)buf;
+    synth->scratch1 = scratch1;
+    tts_render_init(&synth->render, ctx, cache, scratch1, scratch2);
+    synth->frame = NULL;
+    synth->frame_len = 0;
+    synth->offset = 0;
+    synth->speed = TTS_SPEED_NORMAL;
+    synth->debt = 0;
+    synth->capacity = TTS_SPEED_FRAME_CAPACITY;
+    synth->fade_out = 0;
+    synth->fade_left = -1;
+    synth->fade_len = 0;
+    amr_wb_resampler_init(&synth->rs, TTS_SAMPLE_RATE);
+    TTS_CTX(ctx)->aborted = 0;
+    return synth;
+}
+
+void tts_synth_restart(struct tts_synth *synth)
+{
+    struct tts_render *r = &synth->render;
+    struct tts_prefetch *prefetch = r->prefetch;
+    struct tts_stats stats = r->stats;
+    f_tts_clock clock = r->clock;
+    int missing_unit = r->missing_unit;
+    int speed = synth->speed;
+    int fade_out = synth->fade_out;
+    int rate = synth->rs.out_rate;
+
+    if (r->entry >= 0)
+        tts_unit_cache_end(r->cache, r->entry, 0);
+    tts_synth_init(r->ctx, r->cache, synth->scratch1, r->scratch2, synth);
+    synth->speed = speed;
+    synth->fade_out = fade_out;
+    tts_synth_set_output_rate(synth, rate);
+    r->missing_unit = missing_unit;
+    r->clock = clock;
+    r->stats = stats;
+    tts_synth_set_prefetch(synth, prefetch);
+}
+
+void tts_synth_set_clock(struct tts_synth *synth, f_tts_clock clock)
+{
+    synth->render.clock = clock;
+}
+
+void tts_synth_get_stats(const struct tts_synth *synth, struct tts_stats *stats)
+{
+    *stats = synth->render.stats;
+}
+
+void tts_synth_reset_stats(struct tts_synth *synth)
+{
+    memset(&synth->render.stats, 0, sizeof(synth->render.stats));
+}
+
+void tts_synth_set_missing_unit(struct tts_synth *synth, int action)
+{
+    synth->render.missing_unit = action;
+}
+
+void tts_synth_set_prefetch(struct tts_synth *synth, struct tts_prefetch *prefetch)
+{
+    synth->render.prefetch = prefetch;
+    if (prefetch)
+        tts_prefetch_reset(prefetch);
+}
+
+void tts_synth_set_speed(struct tts_synth *synth, int speed)
+{
+    if (speed < TTS_SPEED_MIN) speed = TTS_SPEED_MIN;
+    if (speed > TTS_SPEED_MAX) speed = TTS_SPEED_MAX;
+    synth->speed = speed;
+    if (speed == TTS_SPEED_NORMAL)
+        synth->debt = 0;
+}
+
+void tts_synth_set_fade_out(struct tts_synth *synth, int samples)
+{
+    synth->fade_out = samples > 0 ? samples : 0;
+}
+
+int tts_synth_output_rate(const struct tts_synth *synth)
+{
+    return synth->rs.out_rate;
+}
+
+int tts_synth_set_output_rate(struct tts_synth *synth, int rate)
+{
+    int max = tts_get_scratch_mem2_size() / (int)sizeof(int16_t);
+    int capacity = TTS_SPEED_FRAME_CAPACITY * rate / TTS_SAMPLE_RATE;
+
+    if (amr_wb_resampler_get_buf_size(rate) > max) return -1;
+    if (amr_wb_resampler_init(&synth->rs, rate) != 0) return -1;
+    synth->capacity = capacity < max ? capacity : max;
+    synth->debt = 0;
+    return 0;
+}
+
+// Frames are converted in scratch memory 2, which is free until the next frame is rendered.
+static void resample(struct tts_synth *synth)
+{
+    int16_t *buf = (int16_t *)synth->render.scratch2;
+
+    memcpy(amr_wb_resampler_get_input(&synth->rs, buf), synth->frame, TTS_FRAME_SAMPLES * sizeof(buf[0]));
+    synth->frame_len = amr_wb_resampler_process(&synth->rs, buf);
+    synth->frame = buf;
+}
+
+// The frame is copied to scratch memory 2 (unless it is resampled there already).
+static void change_speed(struct tts_synth *synth)
+{
+    struct tts_render *r = &synth->render;
+    int16_t *buf = (int16_t *)r->scratch2;
+    int rate = synth->rs.out_rate;
+    int frame = TTS_FRAME_SAMPLES * rate / TTS_SAMPLE_RATE;
+    // a debt that can't be paid (e.g. pitch lag is too long) is not accumulated beyond this
+    int max_debt = 2 * frame * 256;
+    int debt;
+    int paid;
+
+    synth->debt += frame * 256 - (frame << 16) / synth->speed;
+    if (synth->debt > max_debt) synth->debt = max_debt;
+    if (synth->debt < -max_debt) synth->debt = -max_debt;
+
+    debt = synth->debt >> 8;
+    paid = debt;
+    if (synth->frame != buf)
+        memcpy(buf, synth->frame, synth->frame_len * sizeof(buf[0]));
+    synth->frame_len = tts_speed_apply(buf, synth->frame_len, r->lag * rate / TTS_SAMPLE_RATE,
+                                       synth->capacity, &debt);
+    synth->frame = buf;
+    synth->debt -= (paid - debt) * 256;
+}
+
+// Makes sure that a frame is being output. Returns 0 if all syllables are synthesized.
+// At most one frame is decoded: a frame can only be shortened to nothing if it is silence.
+static int next_frame(struct tts_synth *synth)
+{
+    struct tts_render *r = &synth->render;
+    uint32_t t;
+
+    while (synth->frame == NULL)
+    {
+        synth->frame = tts_render_next(r);
+        synth->frame_len = TTS_FRAME_SAMPLES;
+        synth->offset = 0;
+        if (synth->frame == NULL)
+            return 0;
+        if ((synth->rs.out_rate != TTS_SAMPLE_RATE) || (synth->speed != TTS_SPEED_NORMAL))
+        {
+            t = tts_render_now(r);
+            if (synth->rs.out_rate != TTS_SAMPLE_RATE)
+                resample(synth);
+            if (synth->speed != TTS_SPEED_NORMAL)
+                change_speed(synth);
+            r->stats.output_time += tts_render_now(r) - t;
+        }
+        if (synth->frame_len == 0)
+            synth->frame = NULL;
+    }
+    return 1;
+}
+
+// The rest of the frame being output is faded out (up to `fade_out` samples).
+// At a frame boundary, the next frame is rendered, so that the cut never
+// follows a loud sample.
+static void start_fade(struct tts_synth *synth)
+{
+    int left = 0;
+
+    if ((synth->fade_out > 0) && next_frame(synth))
+    {
+        left = synth->frame_len - synth->offset;
+        if (left > synth->fade_out) left = synth->fade_out;
+    }
+    synth->fade_left = left;
+    synth->fade_len = left;
+}
+
+int tts_synth_step(struct tts_synth *synth, int16_t *out, int max_samples)
+{
+    struct tts_render *r = &synth->render;
+    uint32_t t;
+    int n;
+    int i;
+
+    if (TTS_CTX(r->ctx)->aborted)
+    {
+        if (synth->fade_left < 0)
+            start_fade(synth);
+        if (synth->fade_left == 0)
+        {
+            // a partly filled cache entry is dropped
+            if (r->entry >= 0)
+            {
+                tts_unit_cache_end(r->cache, r->entry, 0);
+                r->entry = -1;
+            }
+            return 0;
+        }
+    }
+
+    if (!next_frame(synth))
+        return 0;
+
+    t = tts_render_now(r);
+    n = synth->frame_len - synth->offset;
+    if (n > max_samples) n = max_samples;
+    if (synth->fade_left > 0)
+    {
+        // linear ramp towards 0, across steps
+        if (n > synth->fade_left) n = synth->fade_left;
+        for (i = 0; i < n; i++)
+            out[i] = (int16_t)(synth->frame[synth->offset + i] * (synth->fade_left - i) / (synth->fade_len + 1));
+        synth->fade_left -= n;
+        if (synth->fade_left == 0)
+        {
+            // the rest of the frame is dropped
+            synth->frame_len = synth->offset + n;
+            // when preempted, the new text follows
+            if (!TTS_CTX(r->ctx)->aborted)
+                synth->fade_left = -1;
+        }
+    }
+    else
+        memcpy(out, synth->frame + synth->offset, n * sizeof(out[0]));
+    r->stats.output_time += tts_render_now(r) - t;
+    r->stats.samples += n;
+
+    synth->offset += n;
+    if (synth->offset >= synth->frame_len)
+        synth->frame = NULL;
+    return n;
+}
+
+int tts_synth_preempt(struct tts_synth *synth, const char *utf8_str)
+{
+    struct tts_render *r = &synth->render;
+    const int16_t *frame;
+    int offset;
+    int left;
+    int len;
+
+    if (synth->fade_left < 0)
+        start_fade(synth);
+
+    // the frame being faded out stays where it is (scratch memory or the
+    // unit cache) until the next frame is rendered
+    frame = synth->frame;
+    offset = synth->offset;
+    left = synth->fade_left;
+    len = synth->fade_len;
+
+    tts_synth_restart(synth);
+    tts_reset(r->ctx);
+
+    if (left > 0)
+    {
+        synth->frame = frame;
+        synth->offset = offset;
+        synth->frame_len = offset + left;
+        synth->fade_left = left;
+        synth->fade_len = len;
+    }
+
+    return tts_push_utf8_str(r->ctx, utf8_str);
+}
@@ -0,0 +1,197 @@
+#include "tts_priv.h"
+#include <stdarg.h>
+#include <string.h>
+
+#define MAX_SLOTS               16
+
+// bytes of a literal pushed at once
+#define CHUNK_MAX_BYTES         120
+
+struct template_slot
+{
+    uint16_t pos;               // slot value goes before this syllable
+    uint8_t type;               // TTS_SLOT_xxx
+    uint8_t reserved;
+};
+
+// followed by: slots[slot_num], units[syllable_num], flags[syllable_num]
+struct tts_template
+{
+    uint16_t syllable_num;
+    uint8_t slot_num;
+    uint8_t reserved;
+};
+
+#define TPL_SLOTS(tpl)          ((const struct template_slot *)((tpl) + 1))
+#define TPL_UNITS(tpl)          ((const int16_t *)(TPL_SLOTS(tpl) + (tpl)->slot_num))
+#define TPL_FLAGS(tpl)          ((const uint8_t *)(TPL_UNITS(tpl) + (tpl)->syllable_num))
+
+static const struct
+{
+    const char *name;
+    uint8_t type;
+} slot_types[] =
+{
+    {"int",     TTS_SLOT_INTEGER},
+    {"money",   TTS_SLOT_YUAN_JIAO_FEN},
+    {"text",    TTS_SLOT_UTF8_STR},
+};
+
+// `s` points to the char after '{'; returns slot type, or -1
+static int parse_slot(const char *s, const char **end)
+{
+    const char *close = strchr(s, '}');
+    const char *type = s;
+    const char *p;
+    int i;
+
+    if (close == NULL) return -1;
+    *end = close + 1;
+
+    // optional name: {amount:money}
+    for (p = s; p < close; p++)
+        if (*p == ':') type = p + 1;
+
+    for (i = 0; i < (int)(sizeof(slot_types) / sizeof(slot_types[0])); i++)
+    {
+        int len = (int)strlen(slot_types[i].name);
+        if ((close - type == len) && (memcmp(type, slot_types[i].name, len) == 0))
+            return slot_types[i].type;
+    }
+    return -1;
+}
+
+static int push_literal(struct tts_context *ctx, const char *s, int len)
+{
+    char chunk[CHUNK_MAX_BYTES + 1];
+
+    while (len > 0)
+    {
+        int n = len;
+        if (n > CHUNK_MAX_BYTES)
+        {
+            n = CHUNK_MAX_BYTES;
+            while ((n > 0) && (((uint8_t)s[n] & 0xc0) == 0x80)) n--;
+        }
+        memcpy(chunk, s, n);
+        chunk[n] = '\0';
+        if (tts_push_utf8_str(ctx, chunk) != 0)
+            return -1;
+        s += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int compile(struct tts_context *ctx, const char *template_str, void *buf, int buf_size)
+{
+    struct tts_context_head *head = TTS_CTX(ctx);
+    struct template_slot slots[MAX_SLOTS];
+    struct tts_template *tpl = (struct tts_template *)buf;
+    const char *s = template_str;
+    int slot_num = 0;
+    int size;
+
+    tts_reset(ctx);
+
+    while (*s)
+    {
+        const char *brace = strchr(s, '{');
+        const char *end = brace ? brace : s + strlen(s);
+        int type;
+
+        if (push_literal(ctx, s, (int)(end - s)) != 0)
+            return -1;
+        if (brace == NULL)
+            break;
+
+        type = parse_slot(brace + 1, &s);
+        if ((type < 0) || (slot_num >= MAX_SLOTS))
+            return -1;
+
+        slots[slot_num].pos = (uint16_t)head->syllable_num;
+        slots[slot_num].type = (uint8_t)type;
+        slots[slot_num].reserved = 0;
+        slot_num++;
+    }
+
+    size = sizeof(struct tts_template) + slot_num * sizeof(struct template_slot)
+         + head->syllable_num * (sizeof(int16_t) + sizeof(uint8_t));
+    if (buf == NULL)
+        return size;
+    if (size > buf_size)
+        return -1;
+
+    tpl->syllable_num = (uint16_t)head->syllable_num;
+    tpl->slot_num = (uint8_t)slot_num;
+    tpl->reserved = 0;
+    memcpy((void *)TPL_SLOTS(tpl), slots, slot_num * sizeof(slots[0]));
+    memcpy((void *)TPL_UNITS(tpl), head->units, head->syllable_num * sizeof(int16_t));
+    memcpy((void *)TPL_FLAGS(tpl), head->flags, head->syllable_num * sizeof(uint8_t));
+    return size;
+}
+
+int tts_compile_template(struct tts_context *ctx, const char *template_str, void *buf, int buf_size)
+{
+    int size = compile(ctx, template_str, buf, buf_size);
+
+    // syllables of the template are not left in the context, whatever the result
+    tts_reset(ctx);
+    return size;
+}
+
+static int push_syllables(struct tts_context *ctx, const int16_t *units, const uint8_t *flags, int from, int to)
+{
+    for (; from < to; from++)
+        if (tts_push_syllable(ctx, units[from], flags[from]) < 0)
+            return -1;
+    return 0;
+}
+
+int tts_push_template(struct tts_context *ctx, const struct tts_template *tpl, ...)
+{
+    const struct template_slot *slots = TPL_SLOTS(tpl);
+    const int16_t *units = TPL_UNITS(tpl);
+    const uint8_t *flags = TPL_FLAGS(tpl);
+    int pos = 0;
+    int r = 0;
+    int i;
+    va_list args;
+
+    va_start(args, tpl);
+
+    for (i = 0; i < tpl->slot_num; i++)
+    {
+        r = push_syllables(ctx, units, flags, pos, slots[i].pos);
+        if (r != 0) break;
+        pos = slots[i].pos;
+
+        switch (slots[i].type)
+        {
+        case TTS_SLOT_INTEGER:
+            r = tts_push_integer(ctx, va_arg(args, int64_t));
+            break;
+        case TTS_SLOT_YUAN_JIAO_FEN:
+            {
+                int64_t yuan = va_arg(args, int64_t);
+                int jiao = va_arg(args, int);
+                int fen = va_arg(args, int);
+                r = tts_push_yuan_jiao_fen(ctx, yuan, (uint8_t)jiao, (uint8_t)fen);
+            }
+            break;
+        case TTS_SLOT_UTF8_STR:
+            r = tts_push_utf8_str(ctx, va_arg(args, const char *));
+            break;
+        default:
+            r = -1;
+            break;
+        }
+        if (r != 0) break;
+    }
+
+    if (r == 0)
+        r = push_syllables(ctx, units, flags, pos, tpl->syllable_num);
+
+    va_end(args);
+    return r;
+}
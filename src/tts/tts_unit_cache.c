@@ -0,0 +1,296 @@
+#include "tts_priv.h"
+#include <string.h>
+
+// Decoded units are kept in blocks of one frame. Blocks of a unit are chained,
+// and entries are kept in a LRU list, most recently used first.
+
+#define NIL             0xffff
+
+struct cache_entry
+{
+    int16_t unit;
+    uint8_t flags;
+    uint8_t tune;
+    uint16_t first_block;
+    uint16_t last_block;
+    uint16_t prev;
+    uint16_t next;
+};
+
+struct tts_unit_cache
+{
+    const struct voice_definition *voice;
+    int block_num;
+    uint16_t lru_head;
+    uint16_t lru_tail;
+    uint16_t free_entry;
+    uint16_t free_block;
+    int used_blocks;
+    struct tts_unit_cache_stats stats;
+    struct cache_entry *entries;
+    uint16_t *next_block;
+    uint16_t *lags;             // pitch lag of each block
+    int16_t (*blocks)[TTS_FRAME_SAMPLES];
+};
+
+#define ALIGN4(n)       (((n) + 3) & ~3)
+
+int tts_get_unit_cache_size(int frames)
+{
+    if ((frames < 1) || (frames >= NIL)) return 0;
+    return ALIGN4(sizeof(struct tts_unit_cache))
+         + frames * TTS_FRAME_SAMPLES * sizeof(int16_t)
+         + frames * sizeof(struct cache_entry)
+         + ALIGN4(frames * sizeof(uint16_t))
+         + ALIGN4(frames * sizeof(uint16_t));
+}
+
+void tts_unit_cache_clear(struct tts_unit_cache *cache)
+{
+    int i;
+
+    for (i = 0; i < cache->block_num; i++)
+    {
+        cache->entries[i].next = (uint16_t)(i + 1);
+        cache->next_block[i] = (uint16_t)(i + 1);
+    }
+    cache->entries[cache->block_num - 1].next = NIL;
+    cache->next_block[cache->block_num - 1] = NIL;
+
+    cache->lru_head = NIL;
+    cache->lru_tail = NIL;
+    cache->free_entry = 0;
+    cache->free_block = 0;
+    cache->used_blocks = 0;
+    cache->voice = NULL;
+}
+
+struct tts_unit_cache *tts_unit_cache_init(int frames, void *buf)
+{
+    struct tts_unit_cache *cache = (struct tts_unit_cache *)buf;
+    uint8_t *p = (uint8_t *)buf + ALIGN4(sizeof(struct tts_unit_cache));
+
+    if (tts_get_unit_cache_size(frames) == 0) return NULL;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->block_num = frames;
+    cache->blocks = (int16_t (*)[TTS_FRAME_SAMPLES])p;
+    p += frames * TTS_FRAME_SAMPLES * sizeof(int16_t);
+    cache->entries = (struct cache_entry *)p;
+    p += frames * sizeof(struct cache_entry);
+    cache->next_block = (uint16_t *)p;
+    p += ALIGN4(frames * sizeof(uint16_t));
+    cache->lags = (uint16_t *)p;
+
+    tts_unit_cache_clear(cache);
+    return cache;
+}
+
+void tts_unit_cache_get_stats(const struct tts_unit_cache *cache, struct tts_unit_cache_stats *stats)
+{
+    *stats = cache->stats;
+    stats->used_frames = cache->used_blocks;
+}
+
+void tts_unit_cache_reset_stats(struct tts_unit_cache *cache)
+{
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+static void lru_unlink(struct tts_unit_cache *cache, int e)
+{
+    struct cache_entry *entry = cache->entries + e;
+    if (entry->prev != NIL) cache->entries[entry->prev].next = entry->next; else cache->lru_head = entry->next;
+    if (entry->next != NIL) cache->entries[entry->next].prev = entry->prev; else cache->lru_tail = entry->prev;
+}
+
+static void lru_push_front(struct tts_unit_cache *cache, int e)
+{
+    struct cache_entry *entry = cache->entries + e;
+    entry->prev = NIL;
+    entry->next = cache->lru_head;
+    if (cache->lru_head != NIL) cache->entries[cache->lru_head].prev = (uint16_t)e; else cache->lru_tail = (uint16_t)e;
+    cache->lru_head = (uint16_t)e;
+}
+
+// returns blocks of an entry (which is not in the LRU list) and the entry to free lists
+static void release(struct tts_unit_cache *cache, int e)
+{
+    struct cache_entry *entry = cache->entries + e;
+    int b = entry->first_block;
+
+    while (b != NIL)
+    {
+        int next = cache->next_block[b];
+        cache->next_block[b] = cache->free_block;
+        cache->free_block = (uint16_t)b;
+        cache->used_blocks--;
+        b = next;
+    }
+
+    entry->next = cache->free_entry;
+    cache->free_entry = (uint16_t)e;
+}
+
+static int evict_lru(struct tts_unit_cache *cache)
+{
+    int e = cache->lru_tail;
+    if (e == NIL) return 0;
+    lru_unlink(cache, e);
+    release(cache, e);
+    cache->stats.evictions++;
+    return 1;
+}
+
+int tts_unit_cache_lookup(struct tts_unit_cache *cache, const struct voice_definition *voice,
+                          int unit, int flags, int tune)
+{
+    int e;
+
+    if (cache->voice != voice)
+    {
+        if (cache->voice) tts_unit_cache_clear(cache);
+        cache->voice = voice;
+    }
+
+    for (e = cache->lru_head; e != NIL; e = cache->entries[e].next)
+    {
+        const struct cache_entry *entry = cache->entries + e;
+        if ((entry->unit == unit) && (entry->flags == flags) && (entry->tune == tune))
+        {
+            if (e != cache->lru_head)
+            {
+                lru_unlink(cache, e);
+                lru_push_front(cache, e);
+            }
+            cache->stats.hits++;
+            return e;
+        }
+    }
+
+    cache->stats.misses++;
+    return -1;
+}
+
+int tts_unit_cache_begin(struct tts_unit_cache *cache, const struct voice_definition *voice,
+                         int unit, int flags, int tune, int frames)
+{
+    struct cache_entry *entry;
+    int e;
+
+    cache->voice = voice;
+
+    // nothing is evicted for a unit that can't be cached anyway
+    if (frames > cache->block_num)
+    {
+        cache->stats.uncacheable++;
+        return -1;
+    }
+
+    if (cache->free_entry == NIL)
+        evict_lru(cache);
+    if (cache->free_entry == NIL)
+        return -1;
+
+    e = cache->free_entry;
+    entry = cache->entries + e;
+    cache->free_entry = entry->next;
+
+    entry->unit = (int16_t)unit;
+    entry->flags = (uint8_t)flags;
+    entry->tune = (uint8_t)tune;
+    entry->first_block = NIL;
+    entry->last_block = NIL;
+    entry->prev = NIL;
+    entry->next = NIL;
+    return e;
+}
+
+int16_t *tts_unit_cache_append(struct tts_unit_cache *cache, int e)
+{
+    struct cache_entry *entry = cache->entries + e;
+    int b;
+
+    // the entry being filled is not in the LRU list, so it is never evicted here
+    while (cache->free_block == NIL)
+    {
+        if (!evict_lru(cache))
+        {
+            cache->stats.uncacheable++;
+            return NULL;
+        }
+    }
+
+    b = cache->free_block;
+    cache->free_block = cache->next_block[b];
+    cache->next_block[b] = NIL;
+    cache->used_blocks++;
+
+    if (entry->last_block != NIL)
+        cache->next_block[entry->last_block] = (uint16_t)b;
+    else
+        entry->first_block = (uint16_t)b;
+    entry->last_block = (uint16_t)b;
+
+    return cache->blocks[b];
+}
+
+void tts_unit_cache_set_lag(struct tts_unit_cache *cache, int e, int lag)
+{
+    cache->lags[cache->entries[e].last_block] = (uint16_t)lag;
+}
+
+void tts_unit_cache_end(struct tts_unit_cache *cache, int e, int complete)
+{
+    if (complete)
+        lru_push_front(cache, e);
+    else
+        release(cache, e);
+}
+
+int tts_unit_cache_first_block(const struct tts_unit_cache *cache, int e)
+{
+    int b = cache->entries[e].first_block;
+    return b == NIL ? -1 : b;
+}
+
+const int16_t *tts_unit_cache_block(const struct tts_unit_cache *cache, int block, int *next, int *lag)
+{
+    int b = cache->next_block[block];
+    *next = b == NIL ? -1 : b;
+    *lag = cache->lags[block];
+    return cache->blocks[block];
+}
+
+int tts_synthesize_cached(struct tts_context *ctx, struct tts_unit_cache *cache,
+    f_tts_receive_pcm_samples rx_samples, void *user_data, void *scratch1, void *scratch2,
+    f_tts_clock clock, struct tts_stats *stats)
+{
+    struct tts_render r;
+    const int16_t *pcm;
+    int acc_number = 0;
+    int ret = 0;
+
+    TTS_CTX(ctx)->aborted = 0;
+    tts_render_init(&r, ctx, cache, scratch1, scratch2);
+    r.clock = clock;
+
+    while ((pcm = tts_render_next(&r)) != NULL)
+    {
+        ret = rx_samples(ctx, pcm, TTS_FRAME_SAMPLES, acc_number, user_data);
+        if (ret != 0) break;
+        acc_number += TTS_FRAME_SAMPLES;
+        if (TTS_CTX(ctx)->aborted) break;
+    }
+
+    // a partly filled entry is dropped
+    if (r.entry >= 0)
+        tts_unit_cache_end(cache, r.entry, 0);
+
+    if (stats)
+    {
+        *stats = r.stats;
+        stats->samples = acc_number;
+    }
+    return ret;
+}
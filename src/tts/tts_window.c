@@ -0,0 +1,138 @@
+#include "tts_priv.h"
+#include <string.h>
+
+// Text read ahead from the reader. It holds more than a whole phrase, so
+// that a phrase is never cut by the end of the buffer unless the text ends.
+#define TEXT_BUF_SIZE           256
+
+// a phrase that does not fit into the window is split, down to this size
+#define MIN_PHRASE_BYTES        4
+
+struct text_buf
+{
+    f_tts_read_text reader;
+    void *user_data;
+    int pos;
+    int len;
+    int eof;
+    char data[TEXT_BUF_SIZE + 1];
+};
+
+static void refill(struct text_buf *tb)
+{
+    if (tb->pos > 0)
+    {
+        memmove(tb->data, tb->data + tb->pos, tb->len - tb->pos);
+        tb->len -= tb->pos;
+        tb->pos = 0;
+    }
+
+    while (!tb->eof && (tb->len < TEXT_BUF_SIZE))
+    {
+        int n = tb->reader(tb->data + tb->len, TEXT_BUF_SIZE - tb->len, tb->user_data);
+        if (n <= 0)
+            tb->eof = 1;
+        else
+            tb->len += n;
+    }
+
+    tb->data[tb->len] = '\0';
+}
+
+// Starts a new window with the next phrase. Returns 0 if OK, 1 at end of text, -1 on error.
+// Time of text analysis is added to `r`.
+static int next_window(struct tts_context *ctx, struct text_buf *tb, struct tts_render *r)
+{
+    int max_bytes = TTS_PHRASE_MAX_BYTES;
+
+    refill(tb);
+    if (tb->pos >= tb->len)
+        return 1;
+
+    for (;;)
+    {
+        const char *s = tb->data + tb->pos;
+        const char *rest;
+        uint32_t t;
+
+        // all syllables in the window are rendered
+        tts_reset(ctx);
+        t = tts_render_now(r);
+        rest = tts_push_utf8_phrase_n(ctx, s, max_bytes);
+        r->stats.analysis_time += tts_render_now(r) - t;
+        if (rest != NULL)
+        {
+            // a phrase takes at least one character (a long run of breaks is
+            // split, too), so a shorter piece would not help
+            if (rest == s) return -1;
+            tb->pos += (int)(rest - s);
+            return 0;
+        }
+
+        // too many syllables for the window: try a shorter piece
+        if (max_bytes <= MIN_PHRASE_BYTES)
+            return -1;
+        if (max_bytes > tb->len - tb->pos) max_bytes = tb->len - tb->pos;
+        max_bytes /= 2;
+        if (max_bytes < MIN_PHRASE_BYTES) max_bytes = MIN_PHRASE_BYTES;
+    }
+}
+
+int tts_synthesize_window(struct tts_context *ctx, f_tts_read_text reader, void *reader_data,
+    struct tts_unit_cache *cache, f_tts_receive_pcm_samples rx_samples, void *user_data,
+    void *scratch1, void *scratch2, f_tts_clock clock, struct tts_stats *stats)
+{
+    struct text_buf tb;
+    struct tts_render r;
+    const int16_t *pcm;
+    int acc_number = 0;
+    int ret = 0;
+
+    tb.reader = reader;
+    tb.user_data = reader_data;
+    tb.pos = 0;
+    tb.len = 0;
+    tb.eof = 0;
+
+    TTS_CTX(ctx)->aborted = 0;
+    tts_reset(ctx);
+    tts_render_init(&r, ctx, cache, scratch1, scratch2);
+    r.clock = clock;
+
+    for (;;)
+    {
+        pcm = tts_render_next(&r);
+        if (pcm == NULL)
+        {
+            struct tts_stats acc;
+
+            ret = next_window(ctx, &tb, &r);
+            if (ret != 0)
+            {
+                if (ret > 0) ret = 0;
+                break;
+            }
+            // statistics run across windows
+            acc = r.stats;
+            tts_render_init(&r, ctx, cache, scratch1, scratch2);
+            r.clock = clock;
+            r.stats = acc;
+            continue;
+        }
+
+        ret = rx_samples(ctx, pcm, TTS_FRAME_SAMPLES, acc_number, user_data);
+        if (ret != 0) break;
+        acc_number += TTS_FRAME_SAMPLES;
+        if (TTS_CTX(ctx)->aborted) break;
+    }
+
+    if (r.entry >= 0)
+        tts_unit_cache_end(cache, r.entry, 0);
+
+    if (stats)
+    {
+        *stats = r.stats;
+        stats->samples = acc_number;
+    }
+    return ret;
+}
@@ -0,0 +1,183 @@
+// Benchmark of pitch period search for Linux.
+//
+// Measures the cost of period detection in cycles per input sample, on a
+// synthetic voice whose pitch glides over `STRETCH_DEF_FREQ_RANGE`:
+//
+// - exhaustive: every lag at full rate, once per period (as a time-stretcher does);
+// - coarse:     decimated search then full-rate refinement, once per period;
+// - refine:     refinement of a known lag within a few percent, once per frame
+//               (as the resumable synthesizer does with lags of the decoder).
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "tts_priv.h"
+#include "stretch.h"
+
+#define SECONDS                 10
+
+static const int freq_range[2] = {STRETCH_DEF_FREQ_RANGE};
+
+static double mhz;
+
+// cycles of TSC on x86, otherwise nanoseconds scaled by `-m MHz`
+static double now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (mhz <= 0) return (double)__rdtsc();
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e9 + ts.tv_nsec) * (mhz > 0 ? mhz : 1000) / 1000;
+}
+
+// harmonics of a gliding f0, with some noise
+static int16_t *make_voice(int rate, int num, int16_t **f0_lag)
+{
+    int16_t *x = malloc(num * sizeof(x[0]));
+    double phase = 0;
+    int i;
+    int h;
+
+    *f0_lag = malloc(num * sizeof(int16_t));
+    for (i = 0; i < num; i++)
+    {
+        double t = (double)i / num;
+        double f0 = freq_range[0] * 1.5 + (freq_range[1] * 0.8 - freq_range[0] * 1.5) * (0.5 - 0.5 * cos(6 * M_PI * t));
+        double v = 0;
+
+        phase += 2 * M_PI * f0 / rate;
+        for (h = 1; h <= 10 && h * f0 < rate / 2; h++)
+            v += sin(h * phase) / h;
+        x[i] = (int16_t)(v * 6000 + (rand() % 601 - 300));
+        (*f0_lag)[i] = (int16_t)(rate / f0 + 0.5);
+    }
+    return x;
+}
+
+// within 2% (or 1 sample) of the period in the middle of the window
+static int close_to(int lag, int period)
+{
+    return abs(lag - period) <= period / 50 + 1;
+}
+
+struct result
+{
+    double cycles;
+    long searches;
+    long found;
+    long agree;
+};
+
+static void run(int rate, int repeat)
+{
+    int min_lag = rate / freq_range[1];
+    int max_lag = rate / freq_range[0];
+    int window = 2 * max_lag;
+    int frame = rate / 50;
+    int num = SECONDS * rate;
+    int16_t *lags;
+    int16_t *x = make_voice(rate, num, &lags);
+    struct result res[3];
+    int k;
+    int r;
+
+    memset(res, 0, sizeof(res));
+
+    for (r = 0; r < repeat; r++)
+    {
+        int pos;
+        double t;
+
+        // once per period
+        for (k = 0; k < 2; k++)
+        {
+            int decim = k == 0 ? 1 : TTS_PITCH_DECIM(rate);
+            t = now_cycles();
+            for (pos = 0; pos + window <= num; )
+            {
+                int lag = tts_pitch_search(x + pos, window, min_lag, max_lag, decim, NULL);
+                res[k].searches++;
+                if (lag > 0) res[k].found++;
+                if (close_to(lag, lags[pos + window / 2])) res[k].agree++;
+                pos += lag > 0 ? lag : min_lag;
+            }
+            res[k].cycles += now_cycles() - t;
+        }
+
+        // once per frame, around a known lag
+        t = now_cycles();
+        for (pos = 0; pos + frame <= num; pos += frame)
+        {
+            int lag = lags[pos] + 1;
+            int d = lag / 16 + 1;
+            if (2 * (lag + d) > frame) continue;
+            lag = tts_pitch_search(x + pos, frame, lag - d, lag + d, 1, NULL);
+            res[2].searches++;
+            if (lag > 0) res[2].found++;
+            if (close_to(lag, lags[pos + frame / 2])) res[2].agree++;
+        }
+        res[2].cycles += now_cycles() - t;
+    }
+
+    printf("%5d Hz  lags %3d~%3d  decim %2d\n", rate, min_lag, max_lag, TTS_PITCH_DECIM(rate));
+    for (k = 0; k < 3; k++)
+    {
+        static const char *names[] = {"exhaustive", "coarse", "refine"};
+        double per_sample = res[k].cycles / ((double)num * repeat);
+        printf("  %-10s %8.1f cycles/sample %7.1f MHz   %5.1f%% correct\n", names[k], per_sample,
+               per_sample * rate / 1e6, res[k].searches ? 100.0 * res[k].agree / res[k].searches : 0.0);
+    }
+
+    free(x);
+    free(lags);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "options:\n"
+        "  -m MHz     convert time to cycles at this clock (default: TSC on x86)\n"
+        "  -r N       repeat N times (default: 3)\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int rates[] = {8000, 16000, 48000};
+    int repeat = 3;
+    int c;
+    int i;
+
+    while ((c = getopt(argc, argv, "m:r:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'm':
+            mhz = atof(optarg);
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    printf("kernel: %s\n", tts_pitch_kernel_name());
+    for (i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++)
+        run(rates[i], repeat);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Prompt cache builder for Linux.
+//
+// Synthesizes a list of prompts into the region of a prompt cache, which is
+// then programmed into flash with the firmware, and used read-only or
+// extended on device (see `tts_prompt_cache_init`).
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts.h"
+
+#define MAX_SYLLABLES           1024
+#define MAX_LINE                4096
+
+struct flash
+{
+    uint8_t *data;
+    int size;
+};
+
+static int flash_program(uint32_t offset, const void *data, int size, void *user_data)
+{
+    struct flash *flash = (struct flash *)user_data;
+    const uint8_t *p = (const uint8_t *)data;
+    int i;
+
+    if (offset + size > (uint32_t)flash->size) return -1;
+    // like NOR flash, bits can only be cleared
+    for (i = 0; i < size; i++)
+        flash->data[offset + i] &= p[i];
+    return 0;
+}
+
+static int flash_erase(void *user_data)
+{
+    struct flash *flash = (struct flash *)user_data;
+    memset(flash->data, 0xff, flash->size);
+    return 0;
+}
+
+static int discard(struct tts_context *ctx, const int16_t *pcm_samples, int number, int acc_number, void *user_data)
+{
+    *(int *)user_data += number;
+    return 0;
+}
+
+static void *load_file(const char *fn, long *size)
+{
+    FILE *f = fopen(fn, "rb");
+    void *data;
+
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data && (fread(data, 1, *size, f) != (size_t)*size))
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (data) ((char *)data)[*size] = '\0';
+    return data;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] voice.bin prompts.txt out.bin\n"
+        "\n"
+        "options:\n"
+        "  -s BYTES   size of the region (default: 65536)\n"
+        "  -t TUNE    tune of units, as `tts_tune` on device (default: engine default)\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct flash flash;
+    struct tts_prompt_cache *cache;
+    struct tts_prompt_cache_stats stats;
+    struct tts_context *ctx;
+    const struct voice_definition *voice;
+    void *scratch1;
+    void *scratch2;
+    char line[MAX_LINE];
+    long size;
+    long samples = 0;
+    int tune = -1;
+    int lines = 0;
+    int skipped = 0;
+    int c;
+    FILE *f;
+
+    flash.size = 65536;
+
+    while ((c = getopt(argc, argv, "s:t:h")) != -1)
+    {
+        switch (c)
+        {
+        case 's':
+            flash.size = atoi(optarg);
+            break;
+        case 't':
+            tune = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    voice = (const struct voice_definition *)load_file(argv[optind], &size);
+    if (voice == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[optind]);
+        return 1;
+    }
+
+    ctx = tts_init(voice, MAX_SYLLABLES, malloc(tts_get_context_size(MAX_SYLLABLES)));
+    if (tune >= 0) tts_tune(ctx, (uint8_t)tune);
+    scratch1 = malloc(tts_get_scratch_mem1_size());
+    scratch2 = malloc(tts_get_scratch_mem2_size());
+
+    flash.data = malloc(flash.size);
+    cache = tts_prompt_cache_init(flash.data, flash.size, flash_program, flash_erase, &flash,
+                                  malloc(tts_get_prompt_cache_size()));
+    if (cache == NULL)
+    {
+        fprintf(stderr, "region is too small\n");
+        return 1;
+    }
+
+    f = fopen(argv[optind + 1], "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[optind + 1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        int n = 0;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+
+        lines++;
+        if (tts_synthesize_prompt(ctx, cache, line, NULL, discard, &n, scratch1, scratch2) != 0)
+            skipped++;
+        samples += n;
+    }
+    fclose(f);
+
+    tts_prompt_cache_get_stats(cache, &stats);
+    if (stats.evictions > 0)
+    {
+        fprintf(stderr, "region is full: %u prompts evicted, use a larger one (-s)\n", stats.evictions);
+        return 1;
+    }
+
+    f = fopen(argv[optind + 2], "wb");
+    if ((f == NULL) || (fwrite(flash.data, 1, flash.size, f) != (size_t)flash.size))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[optind + 2]);
+        return 1;
+    }
+    fclose(f);
+
+    printf("prompts:   %d (%d skipped, %u duplicated)\n", lines, skipped, stats.hits);
+    printf("stored:    %d (%u failed)\n", stats.prompts, stats.failures);
+    printf("audio:     %.1f s, %ld bytes as PCM\n", (double)samples / TTS_SAMPLE_RATE, samples * 2);
+    printf("region:    %d of %d bytes in use\n", stats.used_bytes, flash.size);
+
+    return 0;
+}
@@ -0,0 +1,698 @@
+// Batch TTS renderer for Linux.
+//
+// Renders a list of prompts with one or more voices, using a pool of worker
+// threads, each of which owns a TTS context.
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tts.h"
+#include "audio_adpcm.h"
+#include "sbc.h"
+#include "opus.h"
+
+#define WINDOW_SYLLABLES        256
+#define OPUS_FRAME_SAMPLES      (TTS_SAMPLE_RATE / 50)
+#define OPUS_MAX_PACKET         1500
+#define OPUS_SCRATCH_SIZE       (64 * 1024)
+
+enum format
+{
+    FMT_WAV,
+    FMT_PCM,
+    FMT_ADPCM,
+    FMT_MSBC,
+    FMT_OPUS,
+};
+
+static const char *format_names[] = {"wav", "pcm", "adpcm", "msbc", "opus"};
+
+struct prompt
+{
+    char *id;
+    char *text;
+};
+
+struct options
+{
+    enum format format;
+    int threads;
+    int cache_frames;
+    int opus_bitrate;
+    const char *out_dir;
+};
+
+struct batch
+{
+    const struct options *opt;
+    const struct voice_definition *voice;
+    const char *voice_dir;
+    const struct prompt *prompts;
+    int prompt_num;
+
+    pthread_mutex_t lock;
+    int next;
+    int failed;
+    double audio_seconds;
+    double busy_seconds;
+};
+
+// the pseudostack of Opus is global
+static pthread_mutex_t opus_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the front-end splits `[pinyin]` annotations with strtok, which keeps its
+// state in a global
+static pthread_mutex_t strtok_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct pcm_buf
+{
+    int16_t *samples;
+    int num;
+    int capacity;
+};
+
+struct text_reader
+{
+    const char *text;
+    int pos;
+    int len;
+};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double thread_cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *load_file(const char *fn, long *size)
+{
+    FILE *f = fopen(fn, "rb");
+    void *data;
+
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data && (fread(data, 1, *size, f) != (size_t)*size))
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (data) ((char *)data)[*size] = '\0';
+    return data;
+}
+
+// prompt list
+
+static char *parse_json_string(const char **p)
+{
+    const char *s = *p;
+    char *out = malloc(strlen(s) * 2 + 1);
+    char *d = out;
+
+    if (*s != '"') goto error;
+    s++;
+    while (*s != '"')
+    {
+        if (*s == '\0') goto error;
+        if (*s != '\\')
+        {
+            *d++ = *s++;
+            continue;
+        }
+        s++;
+        if (*s == '\0') goto error;
+        switch (*s++)
+        {
+        case 'n': *d++ = '\n'; break;
+        case 't': *d++ = '\t'; break;
+        case 'r': *d++ = '\r'; break;
+        case 'b': *d++ = '\b'; break;
+        case 'f': *d++ = '\f'; break;
+        case 'u':
+            {
+                unsigned c;
+                int n = 0;
+                if ((sscanf(s, "%4x%n", &c, &n) != 1) || (n != 4)) goto error;
+                s += 4;
+                // surrogate pairs are not expected in Chinese texts
+                if (c < 0x80)
+                    *d++ = (char)c;
+                else if (c < 0x800)
+                {
+                    *d++ = (char)(0xc0 | (c >> 6));
+                    *d++ = (char)(0x80 | (c & 0x3f));
+                }
+                else
+                {
+                    *d++ = (char)(0xe0 | (c >> 12));
+                    *d++ = (char)(0x80 | ((c >> 6) & 0x3f));
+                    *d++ = (char)(0x80 | (c & 0x3f));
+                }
+            }
+            break;
+        default:
+            *d++ = s[-1];
+            break;
+        }
+    }
+    *d = '\0';
+    *p = s + 1;
+    return out;
+
+error:
+    free(out);
+    return NULL;
+}
+
+// JSON lines: {"id": "...", "text": "..."}, other keys are ignored
+static int parse_json_line(const char *line, struct prompt *prompt)
+{
+    const char *p = line + 1;
+
+    prompt->id = NULL;
+    prompt->text = NULL;
+
+    for (;;)
+    {
+        char *key;
+        char *value;
+
+        while ((*p == ' ') || (*p == '\t') || (*p == ',')) p++;
+        if ((*p == '}') || (*p == '\0')) break;
+
+        key = parse_json_string(&p);
+        if (key == NULL) return -1;
+        while ((*p == ' ') || (*p == '\t') || (*p == ':')) p++;
+        value = parse_json_string(&p);
+        if (value == NULL)
+        {
+            free(key);
+            return -1;
+        }
+
+        if (strcmp(key, "id") == 0)
+        {
+            free(prompt->id);
+            prompt->id = value;
+        }
+        else if (strcmp(key, "text") == 0)
+        {
+            free(prompt->text);
+            prompt->text = value;
+        }
+        else
+            free(value);
+        free(key);
+    }
+
+    return prompt->text ? 0 : -1;
+}
+
+// an id names the output file in `-o`
+static int is_valid_id(const char *id)
+{
+    if ((id[0] == '\0') || (strcmp(id, ".") == 0) || (strcmp(id, "..") == 0))
+        return 0;
+    return strpbrk(id, "/\\") == NULL;
+}
+
+static struct prompt *load_prompts(const char *fn, int *num)
+{
+    long size;
+    char *data = load_file(fn, &size);
+    char *line;
+    char *save = NULL;
+    struct prompt *prompts = NULL;
+    int n = 0;
+    int capacity = 0;
+    int line_no = 0;
+
+    if (data == NULL) return NULL;
+
+    for (line = strtok_r(data, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        struct prompt prompt;
+        int len = (int)strlen(line);
+
+        line_no++;
+        if ((len > 0) && (line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0) continue;
+
+        if (line[0] == '{')
+        {
+            if (parse_json_line(line, &prompt) != 0)
+            {
+                fprintf(stderr, "%s:%d: bad JSON line\n", fn, line_no);
+                continue;
+            }
+        }
+        else
+        {
+            prompt.id = NULL;
+            prompt.text = strdup(line);
+        }
+
+        if (prompt.id && !is_valid_id(prompt.id))
+        {
+            fprintf(stderr, "%s:%d: bad id: %s\n", fn, line_no, prompt.id);
+            free(prompt.id);
+            free(prompt.text);
+            continue;
+        }
+
+        if (prompt.id == NULL)
+        {
+            char id[16];
+            sprintf(id, "%05d", n);
+            prompt.id = strdup(id);
+        }
+
+        if (n >= capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            prompts = realloc(prompts, capacity * sizeof(prompts[0]));
+        }
+        prompts[n++] = prompt;
+    }
+
+    free(data);
+    *num = n;
+    return prompts;
+}
+
+// rendering
+
+static int read_text(char *buf, int size, void *user_data)
+{
+    struct text_reader *r = (struct text_reader *)user_data;
+    int n = r->len - r->pos;
+    if (n > size) n = size;
+    memcpy(buf, r->text + r->pos, n);
+    r->pos += n;
+    return n;
+}
+
+static int save_pcm_samples(struct tts_context *ctx, const int16_t *pcm_samples, int number,
+                            int acc_number, void *user_data)
+{
+    struct pcm_buf *pcm = (struct pcm_buf *)user_data;
+    (void)ctx;
+    (void)acc_number;
+
+    if (pcm->num + number > pcm->capacity)
+    {
+        int capacity = pcm->capacity ? pcm->capacity * 2 : TTS_SAMPLE_RATE * 4;
+        while (capacity < pcm->num + number) capacity *= 2;
+        pcm->samples = realloc(pcm->samples, capacity * sizeof(int16_t));
+        if (pcm->samples == NULL) return -1;
+        pcm->capacity = capacity;
+    }
+    memcpy(pcm->samples + pcm->num, pcm_samples, number * sizeof(int16_t));
+    pcm->num += number;
+    return 0;
+}
+
+static void put_le(FILE *f, uint32_t v, int bytes)
+{
+    while (bytes-- > 0)
+    {
+        fputc(v & 0xff, f);
+        v >>= 8;
+    }
+}
+
+static void put_be32(FILE *f, uint32_t v)
+{
+    fputc(v >> 24, f);
+    fputc((v >> 16) & 0xff, f);
+    fputc((v >> 8) & 0xff, f);
+    fputc(v & 0xff, f);
+}
+
+static void write_wav(FILE *f, const struct pcm_buf *pcm)
+{
+    uint32_t data_size = pcm->num * sizeof(int16_t);
+
+    fwrite("RIFF", 1, 4, f);
+    put_le(f, 36 + data_size, 4);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put_le(f, 16, 4);
+    put_le(f, 1, 2);                            // PCM
+    put_le(f, 1, 2);                            // mono
+    put_le(f, TTS_SAMPLE_RATE, 4);
+    put_le(f, TTS_SAMPLE_RATE * 2, 4);
+    put_le(f, 2, 2);
+    put_le(f, 16, 2);
+    fwrite("data", 1, 4, f);
+    put_le(f, data_size, 4);
+    fwrite(pcm->samples, sizeof(int16_t), pcm->num, f);
+}
+
+static void adpcm_output(uint8_t output, void *param)
+{
+    fputc(output, (FILE *)param);
+}
+
+static void write_adpcm(FILE *f, const struct pcm_buf *pcm)
+{
+    adpcm_enc_t enc;
+    adpcm_enc_init(&enc, adpcm_output, f);
+    adpcm_encode(&enc, pcm->samples, pcm->num);
+}
+
+static int write_msbc(FILE *f, const struct pcm_buf *pcm)
+{
+    static const struct sbc_frame frame =
+    {
+        .msbc = true,
+        .freq = SBC_FREQ_16K,
+        .mode = SBC_MODE_MONO,
+        .bam = SBC_BAM_LOUDNESS,
+        .nblocks = 15,
+        .nsubbands = 8,
+        .bitpool = 26,
+    };
+    int scratch[SBC_ENCODE_SCRATCH_MEM_SIZE / sizeof(int)];
+    int16_t block[SBC_MSBC_SAMPLES];
+    uint8_t data[SBC_MSBC_SIZE];
+    sbc_t sbc;
+    int i;
+
+    sbc_reset(&sbc);
+    for (i = 0; i < pcm->num; i += SBC_MSBC_SAMPLES)
+    {
+        int n = pcm->num - i < SBC_MSBC_SAMPLES ? pcm->num - i : SBC_MSBC_SAMPLES;
+        memcpy(block, pcm->samples + i, n * sizeof(int16_t));
+        memset(block + n, 0, (SBC_MSBC_SAMPLES - n) * sizeof(int16_t));
+        if (sbc_encode2(&sbc, block, 1, NULL, 0, &frame, data, sizeof(data), scratch) != 0)
+            return -1;
+        fwrite(data, 1, sizeof(data), f);
+    }
+    return 0;
+}
+
+// bit stream of opus_demo: for each packet, length and final range (big endian), then the packet
+static int write_opus(FILE *f, const struct pcm_buf *pcm, OpusEncoder *enc)
+{
+    int16_t frame[OPUS_FRAME_SAMPLES];
+    uint8_t packet[OPUS_MAX_PACKET];
+    int ret = 0;
+    int i;
+
+    pthread_mutex_lock(&opus_lock);
+    for (i = 0; i < pcm->num; i += OPUS_FRAME_SAMPLES)
+    {
+        opus_uint32 range;
+        int n = pcm->num - i < OPUS_FRAME_SAMPLES ? pcm->num - i : OPUS_FRAME_SAMPLES;
+        int len;
+
+        memcpy(frame, pcm->samples + i, n * sizeof(int16_t));
+        memset(frame + n, 0, (OPUS_FRAME_SAMPLES - n) * sizeof(int16_t));
+        len = opus_encode(enc, frame, OPUS_FRAME_SAMPLES, packet, sizeof(packet));
+        if (len < 0)
+        {
+            ret = -1;
+            break;
+        }
+        opus_encoder_ctl(enc, OPUS_GET_FINAL_RANGE(&range));
+        put_be32(f, len);
+        put_be32(f, range);
+        fwrite(packet, 1, len, f);
+    }
+    pthread_mutex_unlock(&opus_lock);
+    return ret;
+}
+
+static int write_output(struct batch *batch, const struct prompt *prompt, const struct pcm_buf *pcm,
+                        OpusEncoder *opus)
+{
+    char fn[1024];
+    FILE *f;
+    int ret = 0;
+
+    snprintf(fn, sizeof(fn), "%s/%s.%s", batch->voice_dir, prompt->id, format_names[batch->opt->format]);
+    f = fopen(fn, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "can't create %s: %s\n", fn, strerror(errno));
+        return -1;
+    }
+
+    switch (batch->opt->format)
+    {
+    case FMT_WAV:   write_wav(f, pcm); break;
+    case FMT_PCM:   fwrite(pcm->samples, sizeof(int16_t), pcm->num, f); break;
+    case FMT_ADPCM: write_adpcm(f, pcm); break;
+    case FMT_MSBC:  ret = write_msbc(f, pcm); break;
+    case FMT_OPUS:  ret = write_opus(f, pcm, opus); break;
+    }
+
+    fclose(f);
+    return ret;
+}
+
+static void *worker(void *param)
+{
+    struct batch *batch = (struct batch *)param;
+    const struct options *opt = batch->opt;
+    void *ctx_buf = malloc(tts_get_context_size(WINDOW_SYLLABLES));
+    void *scratch1 = malloc(tts_get_scratch_mem1_size());
+    void *scratch2 = malloc(tts_get_scratch_mem2_size());
+    void *cache_buf = opt->cache_frames > 0 ? malloc(tts_get_unit_cache_size(opt->cache_frames)) : NULL;
+    OpusEncoder *opus = NULL;
+    struct tts_context *ctx = tts_init(batch->voice, WINDOW_SYLLABLES, ctx_buf);
+    struct tts_unit_cache *cache = cache_buf ? tts_unit_cache_init(opt->cache_frames, cache_buf) : NULL;
+    struct pcm_buf pcm = {NULL, 0, 0};
+    double audio_seconds = 0;
+    double cpu_start = thread_cpu_seconds();
+    int failed = 0;
+
+    if (opt->format == FMT_OPUS)
+    {
+        opus = malloc(opus_encoder_get_size(1));
+        opus_encoder_init(opus, TTS_SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP);
+        opus_encoder_ctl(opus, OPUS_SET_BITRATE(opt->opus_bitrate));
+    }
+
+    for (;;)
+    {
+        const struct prompt *prompt;
+        struct text_reader reader;
+        int serialized;
+        int index;
+        int r;
+
+        pthread_mutex_lock(&batch->lock);
+        index = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        if (index >= batch->prompt_num) break;
+
+        prompt = batch->prompts + index;
+        reader.text = prompt->text;
+        reader.pos = 0;
+        reader.len = (int)strlen(prompt->text);
+        pcm.num = 0;
+
+        if (opus) opus_encoder_ctl(opus, OPUS_RESET_STATE);
+
+        serialized = strchr(prompt->text, '[') != NULL;
+        if (serialized) pthread_mutex_lock(&strtok_lock);
+        r = tts_synthesize_window(ctx, read_text, &reader, cache, save_pcm_samples, &pcm,
+                                  scratch1, scratch2, NULL, NULL);
+        if (serialized) pthread_mutex_unlock(&strtok_lock);
+
+        if ((r != 0) || (write_output(batch, prompt, &pcm, opus) != 0))
+        {
+            fprintf(stderr, "failed: %s\n", prompt->id);
+            failed++;
+            continue;
+        }
+
+        audio_seconds += (double)pcm.num / TTS_SAMPLE_RATE;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->failed += failed;
+    batch->audio_seconds += audio_seconds;
+    batch->busy_seconds += thread_cpu_seconds() - cpu_start;
+    pthread_mutex_unlock(&batch->lock);
+
+    free(pcm.samples);
+    free(opus);
+    free(cache_buf);
+    free(scratch2);
+    free(scratch1);
+    free(ctx_buf);
+    return NULL;
+}
+
+static const char *base_name(const char *path, char *buf, int size)
+{
+    const char *s = strrchr(path, '/');
+    char *dot;
+
+    snprintf(buf, size, "%s", s ? s + 1 : path);
+    dot = strrchr(buf, '.');
+    if (dot) *dot = '\0';
+    return buf;
+}
+
+static int render_voice(const struct options *opt, const char *voice_fn,
+                        const struct prompt *prompts, int prompt_num)
+{
+    struct batch batch;
+    pthread_t *threads = calloc(opt->threads, sizeof(pthread_t));
+    char name[256];
+    char dir[1024];
+    long size;
+    double start;
+    double wall;
+    int i;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.voice = load_file(voice_fn, &size);
+    if (batch.voice == NULL)
+    {
+        fprintf(stderr, "can't load voice %s\n", voice_fn);
+        free(threads);
+        return -1;
+    }
+
+    snprintf(dir, sizeof(dir), "%s/%s", opt->out_dir, base_name(voice_fn, name, sizeof(name)));
+    mkdir(opt->out_dir, 0755);
+    mkdir(dir, 0755);
+
+    batch.opt = opt;
+    batch.voice_dir = dir;
+    batch.prompts = prompts;
+    batch.prompt_num = prompt_num;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    start = now_seconds();
+    for (i = 0; i < opt->threads; i++)
+        pthread_create(threads + i, NULL, worker, &batch);
+    for (i = 0; i < opt->threads; i++)
+        pthread_join(threads[i], NULL);
+    wall = now_seconds() - start;
+
+    // RTF: processing time / audio duration
+    printf("%s: %d prompts (%d failed), audio %.1fs, wall %.2fs, RTF %.4f (per core %.4f)\n",
+           name, prompt_num, batch.failed, batch.audio_seconds, wall,
+           batch.audio_seconds > 0 ? wall / batch.audio_seconds : 0,
+           batch.audio_seconds > 0 ? batch.busy_seconds / batch.audio_seconds : 0);
+
+    pthread_mutex_destroy(&batch.lock);
+    free((void *)batch.voice);
+    free(threads);
+    return batch.failed ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] -v voice.bin [-v voice2.bin ...] prompts.txt\n"
+        "\n"
+        "prompts.txt: one prompt per line, either plain text, or a JSON object\n"
+        "             such as {\"id\": \"welcome\", \"text\": \"欢迎使用\"}.\n"
+        "\n"
+        "options:\n"
+        "  -o DIR     output directory (default: out)\n"
+        "  -f FORMAT  wav, pcm, adpcm, msbc or opus (default: wav)\n"
+        "  -j N       number of worker threads (default: number of cores)\n"
+        "  -c FRAMES  size of unit cache of each worker in frames (default: 1000, 0 to disable)\n"
+        "  -b BPS     Opus bitrate (default: 24000)\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct options opt;
+    const char *voices[32];
+    struct prompt *prompts;
+    int voice_num = 0;
+    int prompt_num = 0;
+    int ret = 0;
+    int c;
+    int i;
+    static uint8_t opus_scratch[OPUS_SCRATCH_SIZE];
+
+    opt.format = FMT_WAV;
+    opt.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    opt.cache_frames = 1000;
+    opt.opus_bitrate = 24000;
+    opt.out_dir = "out";
+
+    while ((c = getopt(argc, argv, "v:o:f:j:c:b:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'v':
+            if (voice_num < (int)(sizeof(voices) / sizeof(voices[0])))
+                voices[voice_num++] = optarg;
+            break;
+        case 'o': opt.out_dir = optarg; break;
+        case 'j': opt.threads = atoi(optarg); break;
+        case 'c': opt.cache_frames = atoi(optarg); break;
+        case 'b': opt.opus_bitrate = atoi(optarg); break;
+        case 'f':
+            for (i = 0; i < (int)(sizeof(format_names) / sizeof(format_names[0])); i++)
+                if (strcmp(optarg, format_names[i]) == 0) break;
+            if (i >= (int)(sizeof(format_names) / sizeof(format_names[0])))
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            opt.format = (enum format)i;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((voice_num < 1) || (optind >= argc))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.threads < 1) opt.threads = 1;
+
+    prompts = load_prompts(argv[optind], &prompt_num);
+    if (prompts == NULL)
+    {
+        fprintf(stderr, "can't load prompts from %s\n", argv[optind]);
+        return 1;
+    }
+
+    opus_set_scratch_mem(opus_scratch, sizeof(opus_scratch));
+
+    for (i = 0; i < voice_num; i++)
+        if (render_voice(&opt, voices[i], prompts, prompt_num) != 0)
+            ret = 1;
+
+    for (i = 0; i < prompt_num; i++)
+    {
+        free(prompts[i].id);
+        free(prompts[i].text);
+    }
+    free(prompts);
+    return ret;
+}
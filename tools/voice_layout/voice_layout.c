@@ -0,0 +1,765 @@
+// Voice definition re-layout tool for Linux.
+//
+// Units that are used by a corpus of typical prompts are placed together:
+// hot units first, each followed by the unit that most often follows it.
+// Hot units are aligned to flash cache lines, and do not cross flash pages.
+// Only unit data and the unit index are changed, so the output is a
+// compatible voice definition of the same format.
+//
+// Optionally, a trie of the lexicon is added for word segmentation (see
+// `struct lexicon_trie`).
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts.h"
+#include "tts_priv.h"
+
+#define MAX_SYLLABLES           1024
+#define MAX_LINE                4096
+#define PAD_BYTE                0xff    // erased flash
+
+struct options
+{
+    int line_size;
+    int page_size;
+    int cache_size;
+    int ways;
+    int hot_percent;
+    int trie;
+};
+
+struct corpus
+{
+    int16_t *units;             // units of all prompts, each prompt ended by -1
+    int len;
+    int cap;
+    int prompts;
+    int skipped;
+};
+
+struct words
+{
+    uint16_t *data;             // each word: length, then characters (code point - TTS_TRIE_FIRST_CHAR)
+    long len;
+    long cap;
+    long *offsets;              // of each word in `data`
+    int num;
+};
+
+struct trie
+{
+    uint32_t *base;
+    uint16_t *check;
+    int cap;
+    int node_num;
+};
+
+struct stats
+{
+    uint64_t reads;             // units read
+    uint64_t lines;             // cache lines accessed
+    uint64_t misses;
+};
+
+static void *load_file(const char *fn, long *size)
+{
+    FILE *f = fopen(fn, "rb");
+    void *data;
+
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data && (fread(data, 1, *size, f) != (size_t)*size))
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (data) ((char *)data)[*size] = '\0';
+    return data;
+}
+
+static void corpus_add(struct corpus *c, int unit)
+{
+    if (c->len >= c->cap)
+    {
+        c->cap = c->cap ? c->cap * 2 : 4096;
+        c->units = realloc(c->units, c->cap * sizeof(c->units[0]));
+    }
+    c->units[c->len++] = (int16_t)unit;
+}
+
+// Runs the text front-end on each line, and keeps units in the order they are read.
+static int load_corpus(const char *fn, const struct voice_definition *voice, struct corpus *c)
+{
+    FILE *f = fopen(fn, "r");
+    void *buf = malloc(tts_get_context_size(MAX_SYLLABLES));
+    struct tts_context *ctx = tts_init(voice, MAX_SYLLABLES, buf);
+    char line[MAX_LINE];
+
+    if ((f == NULL) || (ctx == NULL))
+    {
+        if (f) fclose(f);
+        free(buf);
+        return -1;
+    }
+
+    memset(c, 0, sizeof(*c));
+    while (fgets(line, sizeof(line), f))
+    {
+        struct tts_context_head *head = TTS_CTX(ctx);
+        int i;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+
+        tts_reset(ctx);
+        if (tts_push_utf8_str(ctx, line) != 0)
+        {
+            c->skipped++;
+            continue;
+        }
+
+        for (i = 0; i < head->syllable_num; i++)
+            if (head->units[i] >= 0)
+                corpus_add(c, head->units[i]);
+        corpus_add(c, -1);
+        c->prompts++;
+    }
+
+    fclose(f);
+    free(buf);
+    return 0;
+}
+
+static void words_add(struct words *w, int first, const uint16_t *rest, int rest_len)
+{
+    int i;
+
+    if (w->len + rest_len + 2 > w->cap)
+    {
+        w->cap = (w->cap ? w->cap * 2 : 65536) + rest_len + 2;
+        w->data = realloc(w->data, w->cap * sizeof(w->data[0]));
+    }
+    if ((w->num & 0xffff) == 0)
+        w->offsets = realloc(w->offsets, (w->num + 0x10000) * sizeof(w->offsets[0]));
+
+    w->offsets[w->num++] = w->len;
+    w->data[w->len++] = (uint16_t)(rest_len + 1);
+    w->data[w->len++] = (uint16_t)first;
+    for (i = 0; i < rest_len; i++)
+        w->data[w->len++] = rest[i];
+}
+
+// Each character has a list of the words starting with it:
+// count, then for each word a header (low byte: number of units, high byte:
+// number of following characters), the following characters (code point -
+// TTS_TRIE_FIRST_CHAR) and the units.
+static int load_words(const uint8_t *voice, struct words *w)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    const uint32_t *table = (const uint32_t *)(voice + h->char_table);
+    const uint16_t *lexicon = (const uint16_t *)(voice + h->lexicon);
+    int i;
+
+    if ((h->lexicon - h->char_table) / (2 * sizeof(uint32_t)) != TTS_TRIE_CHAR_NUM)
+        return -1;
+
+    memset(w, 0, sizeof(*w));
+    for (i = 0; i < TTS_TRIE_CHAR_NUM; i++)
+    {
+        const uint16_t *p;
+        int count;
+
+        // characters without words share the list of U+4E00
+        if ((table[i * 2 + 1] == 0) && (i != 0)) continue;
+
+        p = lexicon + table[i * 2 + 1];
+        count = *p++;
+        while (count-- > 0)
+        {
+            int units = *p & 0xff;
+            int chars = *p >> 8;
+            int j;
+
+            // a few words contain punctuation, which is not in the trie
+            p++;
+            for (j = 0; (j < chars) && (p[j] < TTS_TRIE_CHAR_NUM); j++) ;
+            if (j == chars)
+                words_add(w, i, p, chars);
+            p += chars + units;
+        }
+    }
+    return 0;
+}
+
+static const uint16_t *sorted_words;
+
+static int compare_words(const void *a, const void *b)
+{
+    const uint16_t *x = sorted_words + *(const long *)a;
+    const uint16_t *y = sorted_words + *(const long *)b;
+    int i;
+
+    for (i = 1; (i <= x[0]) && (i <= y[0]); i++)
+        if (x[i] != y[i]) return x[i] < y[i] ? -1 : 1;
+    return x[0] - y[0];
+}
+
+// Characters are coded by frequency, so that frequent ones have small codes.
+static void assign_codes(struct words *w, uint16_t *codes)
+{
+    static uint32_t freq[TTS_TRIE_CHAR_NUM];
+    static int chars[TTS_TRIE_CHAR_NUM];
+    int n = 0;
+    int i;
+    int j;
+
+    memset(freq, 0, sizeof(freq));
+    for (i = 0; i < w->num; i++)
+    {
+        const uint16_t *p = w->data + w->offsets[i];
+        for (j = 1; j <= p[0]; j++) freq[p[j]]++;
+    }
+
+    for (i = 0; i < TTS_TRIE_CHAR_NUM; i++)
+        if (freq[i]) chars[n++] = i;
+    for (i = 1; i < n; i++)
+    {
+        int c = chars[i];
+        for (j = i; (j > 0) && (freq[chars[j - 1]] < freq[c]); j--)
+            chars[j] = chars[j - 1];
+        chars[j] = c;
+    }
+
+    memset(codes, 0, TTS_TRIE_CHAR_NUM * sizeof(codes[0]));
+    for (i = 0; i < n; i++)
+        codes[chars[i]] = (uint16_t)(i + 1);
+
+    for (i = 0; i < w->num; i++)
+    {
+        uint16_t *p = w->data + w->offsets[i];
+        for (j = 1; j <= p[0]; j++) p[j] = codes[p[j]];
+    }
+
+    sorted_words = w->data;
+    qsort(w->offsets, w->num, sizeof(w->offsets[0]), compare_words);
+}
+
+static void trie_reserve(struct trie *t, int size)
+{
+    int cap = t->cap;
+
+    if (size <= cap) return;
+    while (cap < size) cap = cap ? cap * 2 : 65536;
+    t->base = realloc(t->base, cap * sizeof(t->base[0]));
+    t->check = realloc(t->check, cap * sizeof(t->check[0]));
+    memset(t->base + t->cap, 0, (cap - t->cap) * sizeof(t->base[0]));
+    memset(t->check + t->cap, 0, (cap - t->cap) * sizeof(t->check[0]));
+    t->cap = cap;
+}
+
+// Builds a double array from sorted words. The words are first put into a
+// linked trie, which is then placed breadth first, with the first base that
+// fits all the children of a node.
+static void build_trie(const struct words *w, struct trie *t)
+{
+    struct node
+    {
+        int first_child;
+        int last_child;
+        int next;
+        uint16_t code;
+        uint8_t end;
+    } *nodes;
+    int node_num = 1;
+    int *path = malloc(65536 * sizeof(int));
+    int *queue;
+    int *dat;
+    char *used;
+    char *base_used;
+    int used_cap;
+    int next_free = 1;
+    int head = 0;
+    int tail = 0;
+    int i;
+
+    nodes = calloc(w->len + 1, sizeof(nodes[0]));
+    nodes[0].first_child = nodes[0].last_child = -1;
+    path[0] = 0;
+
+    for (i = 0; i < w->num; i++)
+    {
+        const uint16_t *p = w->data + w->offsets[i];
+        int depth = 0;
+
+        // words are sorted, so a new child is always the last one
+        while (depth < p[0])
+        {
+            int last = nodes[path[depth]].last_child;
+            if ((last >= 0) && (nodes[last].code == p[depth + 1]))
+            {
+                path[++depth] = last;
+                continue;
+            }
+            break;
+        }
+        for (; depth < p[0]; depth++)
+        {
+            int parent = path[depth];
+            struct node *n = nodes + node_num;
+
+            n->first_child = n->last_child = n->next = -1;
+            n->code = p[depth + 1];
+            if (nodes[parent].last_child >= 0)
+                nodes[nodes[parent].last_child].next = node_num;
+            else
+                nodes[parent].first_child = node_num;
+            nodes[parent].last_child = node_num;
+            path[depth + 1] = node_num++;
+        }
+        nodes[path[p[0]]].end = 1;
+    }
+
+    memset(t, 0, sizeof(*t));
+    used_cap = node_num * 2 + 65536;
+    used = calloc(used_cap, 1);
+    base_used = calloc(used_cap, 1);
+    queue = malloc(node_num * sizeof(int));
+    dat = malloc(node_num * sizeof(int));
+    trie_reserve(t, 1);
+    used[0] = 1;
+    t->node_num = 1;
+    queue[tail++] = 0;
+    dat[0] = 0;
+
+    while (head < tail)
+    {
+        int s = queue[head++];
+        int first = nodes[s].first_child;
+        int pos;
+        int start;
+        int skipped;
+        int b = 0;
+        int c;
+
+        if (nodes[s].end) t->base[dat[s]] |= TTS_TRIE_END;
+        if (first < 0) continue;
+
+        start = next_free > nodes[first].code ? next_free : nodes[first].code + 1;
+        for (pos = start, skipped = 0; ; pos++)
+        {
+            if (pos + 65536 >= used_cap)
+            {
+                used = realloc(used, used_cap * 2);
+                base_used = realloc(base_used, used_cap * 2);
+                memset(used + used_cap, 0, used_cap);
+                memset(base_used + used_cap, 0, used_cap);
+                used_cap *= 2;
+            }
+            if (used[pos])
+            {
+                skipped++;
+                continue;
+            }
+            b = pos - nodes[first].code;
+            if (base_used[b]) continue;
+            for (c = nodes[first].next; (c >= 0) && !used[b + nodes[c].code]; c = nodes[c].next) ;
+            if (c < 0) break;
+        }
+
+        base_used[b] = 1;
+        t->base[dat[s]] |= (uint32_t)b;
+        for (c = first; c >= 0; c = nodes[c].next)
+        {
+            int d = b + nodes[c].code;
+            used[d] = 1;
+            trie_reserve(t, d + 1);
+            t->check[d] = nodes[c].code;
+            if (d + 1 > t->node_num) t->node_num = d + 1;
+            dat[c] = d;
+            queue[tail++] = c;
+        }
+        // a region that is almost full is not searched again
+        if (skipped * 20 >= (pos - start + 1) * 19)
+            next_free = pos;
+        while (used[next_free]) next_free++;
+    }
+
+    free(dat);
+    free(queue);
+    free(base_used);
+    free(used);
+    free(nodes);
+    free(path);
+}
+
+// Returns the voice with a new lexicon trie, which replaces the existing one.
+static uint8_t *add_trie(uint8_t *voice, long *size, int *word_num, int *node_num, long *trie_size)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    const struct lexicon_trie *old = tts_lexicon_trie((const struct voice_definition *)voice);
+    long start = old ? (const uint8_t *)old - voice : (long)h->unit_index;
+    struct lexicon_trie_trailer trailer;
+    struct lexicon_trie *header;
+    struct voice_header *new_h;
+    struct words w;
+    struct trie t;
+    uint8_t *out;
+    uint8_t *p;
+    long len;
+    long delta;
+
+    if (load_words(voice, &w) != 0) return NULL;
+
+    header = calloc(1, sizeof(*header));
+    assign_codes(&w, header->codes);
+    build_trie(&w, &t);
+    header->node_num = (uint32_t)t.node_num;
+
+    len = sizeof(*header) + t.node_num * sizeof(uint32_t)
+        + ((t.node_num * sizeof(uint16_t) + 3) & ~3) + sizeof(trailer);
+    delta = start + len - h->unit_index;
+    out = calloc(1, *size + delta);
+
+    memcpy(out, voice, start);
+    p = out + start;
+    memcpy(p, header, sizeof(*header));
+    p += sizeof(*header);
+    memcpy(p, t.base, t.node_num * sizeof(uint32_t));
+    p += t.node_num * sizeof(uint32_t);
+    memcpy(p, t.check, t.node_num * sizeof(uint16_t));
+    p += (t.node_num * sizeof(uint16_t) + 3) & ~3;
+    trailer.size = (uint32_t)len;
+    trailer.magic = TTS_TRIE_MAGIC;
+    memcpy(p, &trailer, sizeof(trailer));
+    p += sizeof(trailer);
+    memcpy(p, voice + h->unit_index, *size - h->unit_index);
+
+    new_h = (struct voice_header *)out;
+    new_h->unit_index += delta;
+    new_h->unit_data += delta;
+
+    *size += delta;
+    *word_num = w.num;
+    *node_num = t.node_num;
+    *trie_size = len;
+
+    free(t.check);
+    free(t.base);
+    free(header);
+    free(w.offsets);
+    free(w.data);
+    free(voice);
+    return out;
+}
+
+// Orders units: the hottest unit first, then repeatedly the unit that most
+// often follows the last one (or the hottest remaining one). Unused units
+// keep their original order at the end.
+static void order_units(const struct corpus *c, int unit_num, const uint32_t *freq, int *order)
+{
+    uint32_t *follow = calloc((size_t)unit_num * unit_num, sizeof(uint32_t));
+    char *placed = calloc(unit_num, 1);
+    int n = 0;
+    int last = -1;
+    int i;
+
+    for (i = 0; i + 1 < c->len; i++)
+        if ((c->units[i] >= 0) && (c->units[i + 1] >= 0) && (c->units[i] != c->units[i + 1]))
+            follow[c->units[i] * unit_num + c->units[i + 1]]++;
+
+    for (;;)
+    {
+        int best = -1;
+        int u;
+
+        if (last >= 0)
+        {
+            const uint32_t *row = follow + (size_t)last * unit_num;
+            for (u = 0; u < unit_num; u++)
+                if (!placed[u] && row[u] && ((best < 0) || (row[u] > row[best])
+                    || ((row[u] == row[best]) && (freq[u] > freq[best]))))
+                    best = u;
+        }
+
+        if (best < 0)
+        {
+            for (u = 0; u < unit_num; u++)
+                if (!placed[u] && freq[u] && ((best < 0) || (freq[u] > freq[best])))
+                    best = u;
+        }
+
+        if (best < 0) break;
+        order[n++] = best;
+        placed[best] = 1;
+        last = best;
+    }
+
+    for (i = 0; i < unit_num; i++)
+        if (!placed[i]) order[n++] = i;
+
+    free(placed);
+    free(follow);
+}
+
+// Hot units: the most frequent units that cover `percent` of all reads.
+static void mark_hot(int unit_num, const uint32_t *freq, uint64_t total, int percent, char *hot)
+{
+    int *sorted = malloc(unit_num * sizeof(int));
+    uint64_t acc = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < unit_num; i++) sorted[i] = i;
+    for (i = 1; i < unit_num; i++)
+    {
+        int u = sorted[i];
+        for (j = i; (j > 0) && (freq[sorted[j - 1]] < freq[u]); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = u;
+    }
+
+    memset(hot, 0, unit_num);
+    for (i = 0; (i < unit_num) && (acc * 100 < total * percent); i++)
+    {
+        hot[sorted[i]] = 1;
+        acc += freq[sorted[i]];
+    }
+    free(sorted);
+}
+
+// Builds the new voice at `out`. Returns its size.
+static long relayout(const uint8_t *voice, const int *order, const char *hot,
+                     const struct options *opt, uint8_t *out, long *padding)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    int unit_num = TTS_VOICE_UNIT_NUM(voice);
+    uint32_t *index = (uint32_t *)(out + h->unit_index);
+    long pos = h->unit_data;
+    int i;
+
+    memcpy(out, voice, h->unit_data);
+    *padding = 0;
+
+    for (i = 0; i < unit_num; i++)
+    {
+        int u = order[i];
+        int len;
+        const uint8_t *p = tts_voice_unit((const struct voice_definition *)voice, u, &len);
+        long n = len + sizeof(int16_t);
+        long start = pos;
+
+        // addresses are relative to the voice, which is placed at a page boundary
+        if (hot[u])
+        {
+            start = (pos + opt->line_size - 1) / opt->line_size * opt->line_size;
+            if ((n <= opt->page_size) && (start / opt->page_size != (start + n - 1) / opt->page_size))
+                start = (start + opt->page_size - 1) / opt->page_size * opt->page_size;
+        }
+
+        memset(out + pos, PAD_BYTE, start - pos);
+        *padding += start - pos;
+        memcpy(out + start, p - sizeof(int16_t), n);
+        index[u] = (uint32_t)(start - h->unit_data);
+        pos = start + n;
+    }
+
+    return pos;
+}
+
+// Set-associative LRU cache of flash, fed with whole units of the corpus.
+static void simulate(const uint8_t *voice, const struct corpus *c, const struct options *opt, struct stats *st)
+{
+    int sets = opt->cache_size / opt->line_size / opt->ways;
+    long *tags = malloc((size_t)sets * opt->ways * sizeof(long));
+    int i;
+
+    for (i = 0; i < sets * opt->ways; i++) tags[i] = -1;
+    memset(st, 0, sizeof(*st));
+
+    for (i = 0; i < c->len; i++)
+    {
+        long start;
+        long line;
+        int len;
+
+        if (c->units[i] < 0) continue;
+        start = tts_voice_unit((const struct voice_definition *)voice, c->units[i], &len) - sizeof(int16_t) - voice;
+        st->reads++;
+
+        for (line = start / opt->line_size; line <= (start + len + 1) / opt->line_size; line++)
+        {
+            long *set = tags + (line % sets) * opt->ways;
+            int w;
+
+            st->lines++;
+            for (w = 0; (w < opt->ways) && (set[w] != line); w++) ;
+            if (w >= opt->ways)
+            {
+                st->misses++;
+                w = opt->ways - 1;
+            }
+            // most recently used first
+            memmove(set + 1, set, w * sizeof(set[0]));
+            set[0] = line;
+        }
+    }
+
+    free(tags);
+}
+
+static void report(const char *name, const struct stats *st, const struct corpus *c, const struct options *opt)
+{
+    printf("%-10s %10llu %10llu %8.2f%% %12.1f\n", name,
+           (unsigned long long)st->lines, (unsigned long long)st->misses,
+           st->lines ? 100.0 * st->misses / st->lines : 0.0,
+           c->prompts ? (double)st->misses * opt->line_size / c->prompts : 0.0);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] voice.bin corpus.txt out.bin\n"
+        "\n"
+        "corpus.txt: typical prompts, one per line. Repeat a line to weight it.\n"
+        "\n"
+        "options:\n"
+        "  -l BYTES   flash cache line size (default: 32)\n"
+        "  -p BYTES   flash page size (default: 256)\n"
+        "  -s BYTES   flash cache size, for the report (default: 8192)\n"
+        "  -w N       ways of the flash cache, for the report (default: 2)\n"
+        "  -H PERCENT hot units cover this share of reads, and are aligned (default: 90)\n"
+        "  -t         add a trie of the lexicon for word segmentation (replaces an existing one)\n",
+        prog);
+}
+
+static int is_pow2(int v)
+{
+    return (v > 0) && ((v & (v - 1)) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct options opt = {32, 256, 8192, 2, 90, 0};
+    struct corpus corpus;
+    struct stats before;
+    struct stats after;
+    uint8_t *voice;
+    uint8_t *out;
+    uint32_t *freq;
+    int *order;
+    char *hot;
+    long size;
+    long out_size;
+    long padding;
+    long in_size;
+    long trie_size = 0;
+    uint64_t total = 0;
+    int unit_num;
+    int used = 0;
+    int hot_num = 0;
+    int word_num = 0;
+    int node_num = 0;
+    int c;
+    int i;
+    FILE *f;
+
+    while ((c = getopt(argc, argv, "l:p:s:w:H:th")) != -1)
+    {
+        switch (c)
+        {
+        case 'l': opt.line_size = atoi(optarg); break;
+        case 'p': opt.page_size = atoi(optarg); break;
+        case 's': opt.cache_size = atoi(optarg); break;
+        case 'w': opt.ways = atoi(optarg); break;
+        case 'H': opt.hot_percent = atoi(optarg); break;
+        case 't': opt.trie = 1; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if ((argc - optind != 3) || !is_pow2(opt.line_size) || !is_pow2(opt.page_size)
+        || (opt.page_size < opt.line_size) || (opt.ways < 1)
+        || (opt.cache_size < opt.line_size * opt.ways)
+        || (opt.hot_percent < 0) || (opt.hot_percent > 100))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    voice = load_file(argv[optind], &size);
+    if (voice == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[optind]);
+        return 1;
+    }
+
+    in_size = size;
+    if (opt.trie)
+    {
+        voice = add_trie(voice, &size, &word_num, &node_num, &trie_size);
+        if (voice == NULL)
+        {
+            fprintf(stderr, "unknown lexicon format\n");
+            return 1;
+        }
+    }
+
+    if (load_corpus(argv[optind + 1], (const struct voice_definition *)voice, &corpus) != 0)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[optind + 1]);
+        return 1;
+    }
+
+    unit_num = TTS_VOICE_UNIT_NUM(voice);
+    freq = calloc(unit_num, sizeof(freq[0]));
+    order = malloc(unit_num * sizeof(order[0]));
+    hot = malloc(unit_num);
+    for (i = 0; i < corpus.len; i++)
+    {
+        if (corpus.units[i] < 0) continue;
+        if (freq[corpus.units[i]]++ == 0) used++;
+        total++;
+    }
+
+    order_units(&corpus, unit_num, freq, order);
+    mark_hot(unit_num, freq, total, opt.hot_percent, hot);
+    for (i = 0; i < unit_num; i++) hot_num += hot[i];
+
+    // padding is at most a page per unit
+    out = malloc(size + (long)unit_num * opt.page_size);
+    out_size = relayout(voice, order, hot, &opt, out, &padding);
+
+    f = fopen(argv[optind + 2], "wb");
+    if ((f == NULL) || (fwrite(out, 1, out_size, f) != (size_t)out_size))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[optind + 2]);
+        return 1;
+    }
+    fclose(f);
+
+    simulate(voice, &corpus, &opt, &before);
+    simulate(out, &corpus, &opt, &after);
+
+    printf("prompts:   %d (%d skipped)\n", corpus.prompts, corpus.skipped);
+    printf("units:     %d used of %d, %d hot, %llu reads\n", used, unit_num, hot_num, (unsigned long long)total);
+    printf("size:      %ld -> %ld bytes (%ld bytes of padding)\n", in_size, out_size, padding);
+    if (opt.trie)
+        printf("trie:      %d words, %d nodes, %ld bytes\n", word_num, node_num, trie_size);
+    printf("cache:     %d bytes, %d-way, %d-byte lines\n", opt.cache_size, opt.ways, opt.line_size);
+    printf("\n%-10s %10s %10s %9s %12s\n", "layout", "lines", "misses", "miss rate", "bytes/prompt");
+    report("original", &before, &corpus, &opt);
+    report("new", &after, &corpus, &opt);
+    if (before.misses)
+        printf("\nmisses reduced by %.1f%%\n", 100.0 - 100.0 * after.misses / before.misses);
+
+    return 0;
+}
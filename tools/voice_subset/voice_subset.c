@@ -0,0 +1,269 @@
+// Subset voice definition extraction tool for Linux.
+//
+// Keeps only units that are needed by a list of phrases, a list of pinyin
+// syllables and (optionally) numbers and money. Other units are replaced by
+// an empty unit, which the engine skips (or plays as a beep, see
+// `tts_synth_set_missing_unit`). Tables of the text front-end are indexed by
+// character, and are kept as they are.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts.h"
+#include "tts_priv.h"
+
+#define MAX_SYLLABLES           1024
+#define MAX_LINE                4096
+
+struct subset
+{
+    struct tts_context *ctx;
+    char *keep;
+    int lines;
+    int skipped;
+};
+
+static void *load_file(const char *fn, long *size)
+{
+    FILE *f = fopen(fn, "rb");
+    void *data;
+
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size + 1);
+    if (data && (fread(data, 1, *size, f) != (size_t)*size))
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    if (data) ((char *)data)[*size] = '\0';
+    return data;
+}
+
+// keeps units of the syllables pushed since `tts_reset`
+static void keep_units(struct subset *s, int r)
+{
+    struct tts_context_head *head = TTS_CTX(s->ctx);
+    int i;
+
+    if (r != 0)
+    {
+        s->skipped++;
+        return;
+    }
+
+    for (i = 0; i < head->syllable_num; i++)
+        if (head->units[i] >= 0)
+            s->keep[head->units[i]] = 1;
+}
+
+// Each line is a phrase, or a pinyin syllable if `pinyin` is set.
+static int add_lines(struct subset *s, const char *fn, int pinyin)
+{
+    FILE *f = fopen(fn, "r");
+    char line[MAX_LINE];
+    char text[MAX_LINE + 2];
+
+    if (f == NULL) return -1;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+
+        if (pinyin)
+            snprintf(text, sizeof(text), "[%s]", line);
+        else
+            strcpy(text, line);
+
+        tts_reset(s->ctx);
+        keep_units(s, tts_push_utf8_str(s->ctx, text));
+        s->lines++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// Numbers and money as spoken by `tts_push_integer` and `tts_push_yuan_jiao_fen`.
+static void add_numbers(struct subset *s)
+{
+    static const int64_t values[] =
+    {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 20, 22, 100, 101, 110, 200, 202, 220, 1000, 1001,
+        1010, 2000, 2002, 2020, 10000, 10001, 20000, 22222, 100000, 1000000, 10000000, 100000000,
+        100000001, 200000000, 1000000000000LL, 2000000000000LL, -1, -2,
+    };
+    int i;
+    int jiao;
+
+    for (i = 0; i < (int)(sizeof(values) / sizeof(values[0])); i++)
+    {
+        tts_reset(s->ctx);
+        keep_units(s, tts_push_integer(s->ctx, values[i]));
+
+        for (jiao = 0; jiao < 10; jiao++)
+        {
+            tts_reset(s->ctx);
+            keep_units(s, tts_push_yuan_jiao_fen(s->ctx, values[i] < 0 ? 0 : values[i],
+                                                 (uint8_t)jiao, (uint8_t)((jiao + i) % 10)));
+        }
+    }
+}
+
+// Builds the subset voice at `out`, which has room for `capacity` bytes.
+// Returns its size, or -1 if it does not fit.
+static long extract(const uint8_t *voice, const char *keep, uint8_t *out, long capacity, int *kept)
+{
+    const struct voice_header *h = TTS_VOICE_HEADER(voice);
+    int unit_num = TTS_VOICE_UNIT_NUM(voice);
+    uint32_t *index = (uint32_t *)(out + h->unit_index);
+    long pos = h->unit_data;
+    uint32_t empty;
+    int i;
+
+    if (pos + (long)sizeof(int16_t) > capacity)
+        return -1;
+    memcpy(out, voice, h->unit_data);
+
+    // all missing units share an empty unit
+    memset(out + pos, 0, sizeof(int16_t));
+    empty = 0;
+    pos += sizeof(int16_t);
+    *kept = 0;
+
+    for (i = 0; i < unit_num; i++)
+    {
+        int len;
+        const uint8_t *p;
+
+        if (!keep[i])
+        {
+            index[i] = empty;
+            continue;
+        }
+
+        p = tts_voice_unit((const struct voice_definition *)voice, i, &len);
+        if (pos + len + (long)sizeof(int16_t) > capacity)
+            return -1;
+        memcpy(out + pos, p - sizeof(int16_t), len + sizeof(int16_t));
+        index[i] = (uint32_t)(pos - h->unit_data);
+        pos += len + sizeof(int16_t);
+        (*kept)++;
+    }
+
+    return pos;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] voice.bin out.bin\n"
+        "\n"
+        "options:\n"
+        "  -p FILE    phrases to keep, one per line (can be repeated)\n"
+        "  -s FILE    pinyin syllables to keep, such as \"ni3\", one per line (can be repeated)\n"
+        "  -n         keep numbers and money (tts_push_integer, tts_push_yuan_jiao_fen)\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct subset s;
+    const char *phrase_files[16];
+    const char *syllable_files[16];
+    int phrase_num = 0;
+    int syllable_num = 0;
+    int numbers = 0;
+    uint8_t *voice;
+    uint8_t *out;
+    long size;
+    long out_size;
+    int unit_num;
+    int kept;
+    int c;
+    int i;
+    FILE *f;
+
+    while ((c = getopt(argc, argv, "p:s:nh")) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            if (phrase_num < 16) phrase_files[phrase_num++] = optarg;
+            break;
+        case 's':
+            if (syllable_num < 16) syllable_files[syllable_num++] = optarg;
+            break;
+        case 'n':
+            numbers = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if ((argc - optind != 2) || (phrase_num + syllable_num + numbers == 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    voice = load_file(argv[optind], &size);
+    if (voice == NULL)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[optind]);
+        return 1;
+    }
+
+    unit_num = TTS_VOICE_UNIT_NUM(voice);
+    memset(&s, 0, sizeof(s));
+    s.keep = calloc(unit_num, 1);
+    s.ctx = tts_init((const struct voice_definition *)voice, MAX_SYLLABLES,
+                     malloc(tts_get_context_size(MAX_SYLLABLES)));
+
+    for (i = 0; i < phrase_num; i++)
+        if (add_lines(&s, phrase_files[i], 0) != 0)
+        {
+            fprintf(stderr, "cannot read %s\n", phrase_files[i]);
+            return 1;
+        }
+    for (i = 0; i < syllable_num; i++)
+        if (add_lines(&s, syllable_files[i], 1) != 0)
+        {
+            fprintf(stderr, "cannot read %s\n", syllable_files[i]);
+            return 1;
+        }
+    if (numbers)
+        add_numbers(&s);
+
+    // the shared empty unit makes the subset 2 bytes larger when all units are kept
+    out = malloc(size + sizeof(int16_t));
+    out_size = extract(voice, s.keep, out, size + sizeof(int16_t), &kept);
+    if (out_size < 0)
+    {
+        fprintf(stderr, "malformed voice %s\n", argv[optind]);
+        return 1;
+    }
+
+    f = fopen(argv[optind + 1], "wb");
+    if ((f == NULL) || (fwrite(out, 1, out_size, f) != (size_t)out_size))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[optind + 1]);
+        return 1;
+    }
+    fclose(f);
+
+    printf("lines:     %d (%d skipped)\n", s.lines, s.skipped);
+    printf("units:     %d kept of %d\n", kept, unit_num);
+    printf("size:      %ld -> %ld bytes (front-end tables: %u bytes)\n", size, out_size,
+           TTS_VOICE_HEADER(voice)->unit_index);
+
+    return 0;
+}